@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "alloc_tracking.hpp"
+
+#include <cstdio>
+
+#ifdef EDOPRO_DESKBOT_ALLOC_TRACKING
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+using AllocTracking::Phase;
+using AllocTracking::Sink;
+
+constexpr auto PHASE_COUNT = static_cast<size_t>(Phase::COUNT);
+
+// NOTE: Only trivial thread locals, so accessing them never allocates.
+thread_local Phase current_phase = Phase::OTHER;
+thread_local Sink* current_sink = nullptr;
+thread_local uint64_t current_count = 0U;
+
+std::array<std::atomic<uint64_t>, PHASE_COUNT> total_count{};
+std::array<std::atomic<uint64_t>, PHASE_COUNT> total_bytes{};
+
+auto account(size_t size) noexcept -> void
+{
+	auto const phase = static_cast<size_t>(current_phase);
+	total_count[phase].fetch_add(1U, std::memory_order_relaxed);
+	total_bytes[phase].fetch_add(size, std::memory_order_relaxed);
+	current_count++;
+	if(current_sink != nullptr)
+	{
+		auto& counters = current_sink->phases[phase];
+		counters.count++;
+		counters.bytes += size;
+	}
+}
+
+} // namespace
+
+#if defined(__GLIBC__)
+// Interposing the C allocator also catches Lua (through the Core) and other C
+// libraries. operator new ends up here as well.
+extern "C"
+{
+auto __libc_malloc(size_t size) -> void*;
+auto __libc_calloc(size_t n, size_t size) -> void*;
+auto __libc_realloc(void* ptr, size_t size) -> void*;
+auto __libc_free(void* ptr) -> void;
+
+auto malloc(size_t size) -> void*
+{
+	account(size);
+	return __libc_malloc(size);
+}
+
+auto calloc(size_t n, size_t size) -> void*
+{
+	account(n * size);
+	return __libc_calloc(n, size);
+}
+
+auto realloc(void* ptr, size_t size) -> void*
+{
+	if(size != 0U)
+		account(size);
+	return __libc_realloc(ptr, size);
+}
+
+auto free(void* ptr) -> void
+{
+	__libc_free(ptr);
+}
+}
+
+namespace
+{
+
+auto allocate(size_t size) noexcept -> void*
+{
+	return std::malloc(size);
+}
+
+} // namespace
+#else
+namespace
+{
+
+auto allocate(size_t size) noexcept -> void*
+{
+	account(size);
+	return std::malloc(size);
+}
+
+} // namespace
+#endif // defined(__GLIBC__)
+
+auto operator new(size_t size) -> void*
+{
+	if(auto* ptr = allocate(size); ptr != nullptr)
+		return ptr;
+	throw std::bad_alloc();
+}
+
+auto operator new[](size_t size) -> void*
+{
+	return operator new(size);
+}
+
+auto operator new(size_t size, std::nothrow_t const& /*unused*/) noexcept
+	-> void*
+{
+	return allocate(size);
+}
+
+auto operator new[](size_t size, std::nothrow_t const& /*unused*/) noexcept
+	-> void*
+{
+	return allocate(size);
+}
+
+auto operator delete(void* ptr) noexcept -> void
+{
+	std::free(ptr);
+}
+
+auto operator delete[](void* ptr) noexcept -> void
+{
+	std::free(ptr);
+}
+
+auto operator delete(void* ptr, size_t /*unused*/) noexcept -> void
+{
+	std::free(ptr);
+}
+
+auto operator delete[](void* ptr, size_t /*unused*/) noexcept -> void
+{
+	std::free(ptr);
+}
+
+namespace AllocTracking
+{
+
+auto totals() noexcept -> Sink
+{
+	Sink sink{};
+	for(size_t i = 0U; i < PHASE_COUNT; i++)
+	{
+		sink.phases[i].count = total_count[i].load(std::memory_order_relaxed);
+		sink.phases[i].bytes = total_bytes[i].load(std::memory_order_relaxed);
+	}
+	return sink;
+}
+
+auto thread_count() noexcept -> uint64_t
+{
+	return current_count;
+}
+
+PhaseScope::PhaseScope(Phase phase) noexcept : previous_(current_phase)
+{
+	current_phase = phase;
+}
+
+PhaseScope::~PhaseScope()
+{
+	current_phase = previous_;
+}
+
+SinkScope::SinkScope(Sink& sink) noexcept : previous_(current_sink)
+{
+	current_sink = &sink;
+}
+
+SinkScope::~SinkScope()
+{
+	current_sink = previous_;
+}
+
+} // namespace AllocTracking
+#else
+namespace AllocTracking
+{
+
+auto totals() noexcept -> Sink
+{
+	return Sink{};
+}
+
+} // namespace AllocTracking
+#endif // EDOPRO_DESKBOT_ALLOC_TRACKING
+
+namespace AllocTracking
+{
+
+auto print(char const* title, Sink const& sink) noexcept -> void
+{
+	if constexpr(!ENABLED)
+		return;
+	std::printf("%s allocations:", title);
+	for(size_t i = 0U; i < sink.phases.size(); i++)
+	{
+		auto const& counters = sink.phases[i];
+		if(counters.count == 0U)
+			continue;
+		std::printf(" %s=%llu (%llu bytes)", PHASE_NAMES[i],
+		            static_cast<unsigned long long>(counters.count),
+		            static_cast<unsigned long long>(counters.bytes));
+	}
+	std::printf(".\n");
+}
+
+} // namespace AllocTracking
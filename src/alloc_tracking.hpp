@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_ALLOC_TRACKING_HPP
+#define EDOPRO_DESKBOT_ALLOC_TRACKING_HPP
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+
+// Heap allocation accounting, only active in builds configured with
+// `-Dalloc_tracking=true`. Every allocation is attributed to the pipeline
+// phase and the client (sink) active in the allocating thread. In regular
+// builds everything here compiles down to nothing.
+namespace AllocTracking
+{
+
+#ifdef EDOPRO_DESKBOT_ALLOC_TRACKING
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif // EDOPRO_DESKBOT_ALLOC_TRACKING
+
+enum class Phase : uint8_t
+{
+	OTHER,
+	READ,
+	ENCODE,
+	ANALYZE,
+	ANSWER,
+	DECODE,
+	WRITE,
+
+	COUNT
+};
+
+constexpr std::array<char const*, static_cast<size_t>(Phase::COUNT)>
+	PHASE_NAMES = {"other",  "read",   "encode", "analyze",
+                   "answer", "decode", "write"};
+
+struct Counters
+{
+	uint64_t count;
+	uint64_t bytes;
+};
+
+struct Sink
+{
+	std::array<Counters, static_cast<size_t>(Phase::COUNT)> phases;
+};
+
+// Process-wide totals per phase.
+auto totals() noexcept -> Sink;
+
+// Prints one line per phase that allocated.
+auto print(char const* title, Sink const& sink) noexcept -> void;
+
+#ifdef EDOPRO_DESKBOT_ALLOC_TRACKING
+// Allocations made by this thread so far.
+auto thread_count() noexcept -> uint64_t;
+
+class PhaseScope
+{
+public:
+	explicit PhaseScope(Phase phase) noexcept;
+	~PhaseScope();
+
+	PhaseScope(const PhaseScope&) = delete;
+	PhaseScope(PhaseScope&&) noexcept = delete;
+	auto operator=(const PhaseScope&) -> PhaseScope& = delete;
+	auto operator=(PhaseScope&&) noexcept -> PhaseScope& = delete;
+
+private:
+	Phase const previous_;
+};
+
+class SinkScope
+{
+public:
+	explicit SinkScope(Sink& sink) noexcept;
+	~SinkScope();
+
+	SinkScope(const SinkScope&) = delete;
+	SinkScope(SinkScope&&) noexcept = delete;
+	auto operator=(const SinkScope&) -> SinkScope& = delete;
+	auto operator=(SinkScope&&) noexcept -> SinkScope& = delete;
+
+private:
+	Sink* const previous_;
+};
+#else
+constexpr auto thread_count() noexcept -> uint64_t { return 0U; }
+
+class PhaseScope
+{
+public:
+	explicit constexpr PhaseScope(Phase /*unused*/) noexcept {}
+};
+
+class SinkScope
+{
+public:
+	explicit constexpr SinkScope(Sink& /*unused*/) noexcept {}
+};
+#endif // EDOPRO_DESKBOT_ALLOC_TRACKING
+
+// Counts the allocations made by the current thread while alive, so
+// benchmarks can assert a path is allocation-free in steady state:
+//     AllocTracking::Counter c;
+//     do_work();
+//     assert(!AllocTracking::ENABLED || c.count() == 0U);
+class Counter
+{
+public:
+	Counter() noexcept : start_(thread_count()) {}
+
+	[[nodiscard]] auto count() const noexcept -> uint64_t
+	{
+		return thread_count() - start_;
+	}
+
+private:
+	uint64_t const start_;
+};
+
+} // namespace AllocTracking
+
+#endif // EDOPRO_DESKBOT_ALLOC_TRACKING_HPP
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "answer_cache.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+
+// FNV-1a. Collisions are harmless as entries keep the full request around.
+auto hash(uint8_t const* data, size_t size) noexcept -> uint64_t
+{
+	constexpr uint64_t OFFSET_BASIS = 14695981039346656037U;
+	constexpr uint64_t PRIME = 1099511628211U;
+	uint64_t h = OFFSET_BASIS;
+	for(size_t i = 0U; i < size; i++)
+		h = (h ^ data[i]) * PRIME;
+	return h;
+}
+
+} // namespace
+
+AnswerCache::AnswerCache(ScriptDirectives::CoreMsgSet memoized,
+                         size_t capacity)
+	: memoized_(memoized)
+	, capacity_(capacity)
+	, hand_(0U)
+	, hits_(0U)
+	, misses_(0U)
+	, miss_ns_(0U)
+{}
+
+auto AnswerCache::find(uint8_t const* request, size_t size,
+                       YGOpen::Proto::Duel::Answer* answer,
+                       std::vector<uint8_t>& bytes) noexcept -> bool
+{
+	auto const key = hash(request, size);
+	{
+		std::shared_lock lock(mtx_);
+		if(auto const it = index_.find(key); it != index_.end())
+		{
+			auto& entry = slots_[it->second];
+			if(entry.request.size() == size &&
+			   std::equal(request, request + size, entry.request.data()))
+			{
+				entry.referenced.store(true, std::memory_order_relaxed);
+				bytes = entry.bytes;
+				if(answer != nullptr)
+					answer->CopyFrom(entry.answer);
+				hits_.fetch_add(1U, std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+	misses_.fetch_add(1U, std::memory_order_relaxed);
+	return false;
+}
+
+auto AnswerCache::insert(uint8_t const* request, size_t size,
+                         YGOpen::Proto::Duel::Answer const& answer,
+                         std::vector<uint8_t> const& bytes,
+                         std::chrono::nanoseconds cost) noexcept -> void
+{
+	miss_ns_.fetch_add(static_cast<uint64_t>(cost.count()),
+	                   std::memory_order_relaxed);
+	if(capacity_ == 0U)
+		return;
+	auto const key = hash(request, size);
+	std::scoped_lock lock(mtx_);
+	auto const slot = [&]() -> size_t
+	{
+		// Another client may have missed on the same request meanwhile.
+		if(auto const it = index_.find(key); it != index_.end())
+			return it->second;
+		if(slots_.size() < capacity_)
+		{
+			slots_.emplace_back();
+			return slots_.size() - 1U;
+		}
+		// Sweep giving a second chance to entries hit since the last pass.
+		while(slots_[hand_].referenced.exchange(false,
+		                                        std::memory_order_relaxed))
+			hand_ = (hand_ + 1U) % slots_.size();
+		auto const victim = hand_;
+		hand_ = (hand_ + 1U) % slots_.size();
+		index_.erase(slots_[victim].key);
+		return victim;
+	}();
+	index_[key] = slot;
+	auto& entry = slots_[slot];
+	entry.key = key;
+	// Not referenced until hit, so entries never reused go first.
+	entry.referenced.store(false, std::memory_order_relaxed);
+	entry.request.assign(request, request + size);
+	entry.answer.CopyFrom(answer);
+	entry.bytes = bytes;
+}
+
+auto AnswerCache::stats() const noexcept -> Stats
+{
+	return {hits_.load(std::memory_order_relaxed),
+	        misses_.load(std::memory_order_relaxed),
+	        std::chrono::nanoseconds(miss_ns_.load(std::memory_order_relaxed))};
+}
+
+auto AnswerCache::time_saved() const noexcept -> std::chrono::nanoseconds
+{
+	auto const s = stats();
+	if(s.misses == 0U)
+		return std::chrono::nanoseconds(0);
+	return s.miss_time / s.misses * s.hits;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_ANSWER_CACHE_HPP
+#define EDOPRO_DESKBOT_ANSWER_CACHE_HPP
+#include <atomic>
+#include <chrono>
+#include <cstdint> // uint8_t, uint64_t
+#include <deque>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include <ygopen/proto/duel/answer.hpp>
+
+#include "script_directives.hpp"
+
+// Remembers the answers a script gave to requests it declared deterministic
+// (see ScriptDirectives::memoize), keyed by the raw request as sent by the
+// server, so repeated prompts skip the Core entirely. The rest of the duel
+// state is deliberately not part of the key, the directive is the script's
+// promise that it doesn't matter. Meant to be shared by every client playing
+// the same script and deck; thread-safe.
+//
+// Once full, entries are evicted with the CLOCK algorithm (an approximation
+// of least recently used), so lookups don't need an exclusive lock.
+class AnswerCache
+{
+public:
+	struct Stats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		std::chrono::nanoseconds miss_time; // Spent in the Core on misses.
+	};
+
+	AnswerCache(ScriptDirectives::CoreMsgSet memoized, size_t capacity);
+
+	[[nodiscard]] auto memoizes(uint8_t core_msg) const noexcept -> bool
+	{
+		return memoized_.test(core_msg);
+	}
+
+	// On a hit, copies the answer's wire encoding to `bytes` and, if given,
+	// the answer itself to `answer`.
+	auto find(uint8_t const* request, size_t size,
+	          YGOpen::Proto::Duel::Answer* answer,
+	          std::vector<uint8_t>& bytes) noexcept -> bool;
+
+	// `cost` is the time it took the Core to come up with the answer.
+	auto insert(uint8_t const* request, size_t size,
+	            YGOpen::Proto::Duel::Answer const& answer,
+	            std::vector<uint8_t> const& bytes,
+	            std::chrono::nanoseconds cost) noexcept -> void;
+
+	[[nodiscard]] auto stats() const noexcept -> Stats;
+
+	// Time saved by hits, estimated from the average cost of a miss.
+	[[nodiscard]] auto time_saved() const noexcept -> std::chrono::nanoseconds;
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		std::vector<uint8_t> request;
+		YGOpen::Proto::Duel::Answer answer;
+		std::vector<uint8_t> bytes;
+		// Set by hits (under the shared lock), cleared by the clock hand.
+		std::atomic<bool> referenced;
+	};
+
+	ScriptDirectives::CoreMsgSet const memoized_;
+	size_t const capacity_;
+	mutable std::shared_mutex mtx_;
+	std::unordered_map<uint64_t, size_t> index_; // Key to slot.
+	std::deque<Entry> slots_;                    // Never above capacity_.
+	size_t hand_;
+	std::atomic<uint64_t> hits_;
+	std::atomic<uint64_t> misses_;
+	std::atomic<uint64_t> miss_ns_;
+};
+
+#endif // EDOPRO_DESKBOT_ANSWER_CACHE_HPP
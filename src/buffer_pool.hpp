@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_BUFFER_POOL_HPP
+#define EDOPRO_DESKBOT_BUFFER_POOL_HPP
+#include <cstddef> // size_t
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Thread-safe free list of big objects (such as message buffers), so that
+// many connections can share a few of them instead of holding one each while
+// idle. At most `capacity` free objects are kept around.
+template<typename T>
+class BufferPool
+{
+public:
+	class Deleter
+	{
+	public:
+		constexpr Deleter() noexcept : pool_(nullptr) {}
+		explicit constexpr Deleter(BufferPool* pool) noexcept : pool_(pool) {}
+
+		auto operator()(T* ptr) const noexcept -> void
+		{
+			if(pool_ != nullptr)
+				pool_->release_(ptr);
+			else
+				delete ptr;
+		}
+
+	private:
+		BufferPool* pool_;
+	};
+
+	using Lease = std::unique_ptr<T, Deleter>;
+
+	explicit BufferPool(size_t capacity) : capacity_(capacity)
+	{
+		free_.reserve(capacity_);
+	}
+
+	~BufferPool()
+	{
+		for(auto* ptr : free_)
+			delete ptr;
+	}
+
+	BufferPool(const BufferPool&) = delete;
+	BufferPool(BufferPool&&) noexcept = delete;
+	auto operator=(const BufferPool&) -> BufferPool& = delete;
+	auto operator=(BufferPool&&) noexcept -> BufferPool& = delete;
+
+	// Object not tied to any pool, for users that hold on to it anyway.
+	static auto unpooled() -> Lease { return Lease(new T(), Deleter()); }
+
+	auto acquire() -> Lease
+	{
+		{
+			std::scoped_lock lock(mtx_);
+			if(!free_.empty())
+			{
+				auto* ptr = free_.back();
+				free_.pop_back();
+				return Lease(ptr, Deleter(this));
+			}
+		}
+		return Lease(new T(), Deleter(this));
+	}
+
+	[[nodiscard]] auto free_count() const noexcept -> size_t
+	{
+		std::scoped_lock lock(mtx_);
+		return free_.size();
+	}
+
+private:
+	mutable std::mutex mtx_;
+	std::vector<T*> free_;
+	size_t capacity_;
+
+	auto release_(T* ptr) noexcept -> void
+	{
+		{
+			std::scoped_lock lock(mtx_);
+			if(free_.size() < capacity_)
+			{
+				free_.push_back(ptr);
+				return;
+			}
+		}
+		delete ptr;
+	}
+};
+
+#endif // EDOPRO_DESKBOT_BUFFER_POOL_HPP
@@ -5,9 +5,19 @@
  */
 #include "client.hpp"
 
+#include <atomic>
+#include <boost/asio/as_tuple.hpp>
+#include <boost/asio/bind_allocator.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/compose.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/read.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/asio/write.hpp>
+#include <chrono>
 #include <cstdio>
+#include <cstring> // std::memcpy, std::memmove
 #include <deskbot/api.hpp>
 #include <google/protobuf/arena.h>
 #include <ygopen/codec/edo9300_ocgcore_decode.hpp>
@@ -16,11 +26,38 @@
 #include <ygopen/proto/duel/msg.hpp>
 #include <ygopen/server/basic_encode_context.hpp>
 
+#include "alloc_tracking.hpp"
+#include "answer_cache.hpp"
+#include "core_msg.hpp"
 #include "load_script.hpp"
+#include "record_writer.hpp"
 
 constexpr size_t ANSWER_BUFFER_RESERVE = 1U << 8U;
-constexpr uint32_t HANDSHAKE = 4043399681U;
-constexpr auto CLIENT_VERSION = YGOPro::ClientVersion{{40U, 1U}, {10U, 0U}};
+constexpr size_t READ_BUFFER_SIZE = 1U << 15U;
+// Enough for most lobby messages, bigger ones are read straight into the
+// borrowed message buffer.
+constexpr size_t COMPACT_READ_BUFFER_SIZE = 1U << 8U;
+constexpr int RECONNECT_ATTEMPTS = 3;
+constexpr auto RECONNECT_DELAY = std::chrono::milliseconds(250);
+
+// Completion token reporting errors as a value instead of throwing.
+constexpr auto AS_TUPLE_AWAITABLE =
+	boost::asio::as_tuple(boost::asio::use_awaitable);
+
+// Tells apart the duels of every client in the process in dataset streams.
+std::atomic<uint64_t> next_duel_id{0U};
+
+// Starts an asynchronous operation (or coroutine) with `start`, charging the
+// allocations it makes to `phase` and `sink`. The scopes end before it's
+// awaited: other clients may run on this thread while we're suspended.
+template<typename Start>
+auto charged(AllocTracking::Phase phase, AllocTracking::Sink& sink,
+             Start&& start)
+{
+	AllocTracking::PhaseScope phase_scope(phase);
+	AllocTracking::SinkScope sink_scope(sink);
+	return start();
+}
 
 auto log_cb(void*, Deskbot::LogType lt, std::string_view str) noexcept -> void
 {
@@ -28,52 +65,82 @@ auto log_cb(void*, Deskbot::LogType lt, std::string_view str) noexcept -> void
 }
 
 Client::Client(boost::asio::ip::tcp::socket socket, Options const& options)
-	: socket_(std::move(socket))
+	: msg_pool_(options.msg_pool)
+	, incoming_(msg_pool_ != nullptr
+	                ? BufferPool<YGOPro::STOCMsg>::Lease{}
+	                : BufferPool<YGOPro::STOCMsg>::unpooled())
+	, socket_(std::move(socket))
+	, write_signal_(socket_.get_executor(),
+	                boost::asio::steady_timer::time_point::max())
+	, write_idle_(false)
+	, writes_done_(false)
+	, reconnect_timer_(socket_.get_executor())
+	, read_buffer_(msg_pool_ != nullptr ? COMPACT_READ_BUFFER_SIZE
+	                                    : READ_BUFFER_SIZE)
+	, read_begin_(0U)
+	, read_end_(0U)
+	, connection_(0U)
 	, deck_(options.deck_ptr, options.deck_ptr + options.deck_size)
-	, hosting_(true)
+	, room_id_(options.room_id)
+	, hosting_(options.room_id == 0U)
 	, t0_count_(0)
 	, team_(0U)
 	, duelist_(0)
 	, script_(options.script)
+	, dataset_(options.dataset)
+	, answer_cache_(options.answer_cache)
+	, duel_id_(0U)
+	, exporting_(false)
+	, dataset_arena_()
+	, user_(options.user)
+	, on_room_created_(options.on_room_created)
+	, on_finished_(options.on_finished)
+	, player_(0U)
+	, finished_(false)
+	, resuming_(false)
+	, catching_up_(false)
+	, replayed_msgs_(0U)
+	, alloc_stats_()
 {
-	answer_buffer_.reserve(ANSWER_BUFFER_RESERVE);
+	AllocTracking::SinkScope sink(alloc_stats_);
+	if(msg_pool_ == nullptr)
+		answer_buffer_.reserve(ANSWER_BUFFER_RESERVE);
 	{
-		auto player_info = YGOPro::CTOSMsg::PlayerInfo{};
-		player_info.name[0U] = L'虚';
-		send_msg_(YGOPro::CTOSMsg::make_fixed(player_info));
+		boost::system::error_code ec;
+		endpoint_ = socket_.remote_endpoint(ec);
 	}
+	send_msg_(YGOPro::make_player_info());
 	if(hosting_)
 	{
-		static constexpr uint64_t DUEL_FLAGS = 4295157760U;
 		auto create_game = YGOPro::CTOSMsg::CreateGame{};
-		auto& hi = create_game.host_info;
-		hi.banlist_hash = 0U;
-		hi.allowed = 0x3U; // "OCG/TCG"
-		hi.starting_draw_count = 5U;
-		hi.dont_check_deck_content = 1U;
-		hi.dont_shuffle_deck = 0U;
-		hi.draw_count_per_turn = 1U;
-		hi.duel_flags_high = DUEL_FLAGS >> 32U;
-		hi.handshake = HANDSHAKE;
-		hi.version = CLIENT_VERSION;
-		hi.duel_flags_low = DUEL_FLAGS & 0xFFFFFFFFU;
-		hi.limits.main = {40U, 60U};
-		hi.limits.side = {0U, 15U};
-		hi.limits.extra = {0U, 15U};
+		create_game.host_info = YGOPro::default_host_info();
+		create_game.host_info.t0_count = 1;
+		create_game.host_info.t1_count = 1;
+		create_game.host_info.best_of = 1;
 		send_msg_(YGOPro::CTOSMsg::make_fixed(create_game));
 	}
 	else
 	{
-		auto join_game = YGOPro::CTOSMsg::JoinGame{};
-		join_game.id = 1U;
-		join_game.version = CLIENT_VERSION;
-		send_msg_(YGOPro::CTOSMsg::make_fixed(join_game));
+		send_msg_(YGOPro::make_join_game(room_id_));
 	}
-	do_read_header_();
+	auto const ex = socket_.get_executor();
+	boost::asio::co_spawn(ex, write_loop_(), boost::asio::detached);
+	boost::asio::co_spawn(ex, run_(), boost::asio::detached);
 }
 
 Client::~Client() = default;
 
+auto Client::close() noexcept -> void
+{
+	// No more callbacks nor reconnection attempts from here on.
+	finished_ = true;
+	writes_done_ = true;
+	write_signal_.cancel();
+	reconnect_timer_.cancel();
+	boost::system::error_code ignored;
+	socket_.close(ignored);
+}
+
 auto Client::send_msg_(YGOPro::CTOSMsg msg) noexcept -> void
 {
 	// std::is_trivial seems to be bugged in Visual Studio and that carries on
@@ -83,210 +150,743 @@ auto Client::send_msg_(YGOPro::CTOSMsg msg) noexcept -> void
 	// No need for std::move as long as type is trivially copyable.
 	static_assert(std::is_trivially_copyable_v<YGOPro::CTOSMsg>);
 #endif
-	bool const write_in_progress = !outgoing_.empty();
-	outgoing_.emplace(msg);
-	if(!write_in_progress)
-		do_write_();
+	AllocTracking::PhaseScope phase(AllocTracking::Phase::WRITE);
+	// Waking the write loop up takes a pass of the scheduler before anything
+	// is sent, so when it's idle the message goes out right away instead.
+	size_t written = 0U;
+	if(write_idle_ && pending_.empty())
+	{
+		written = write_now_(msg);
+		if(written == msg.size())
+			return;
+	}
+	pending_.insert(pending_.end(), msg.data() + written,
+	                msg.data() + msg.size());
+	write_signal_.cancel();
 }
 
-auto Client::do_write_() noexcept -> void
+auto Client::write_now_(YGOPro::CTOSMsg const& msg) noexcept -> size_t
 {
-	auto const& msg = outgoing_.front();
-	auto b = boost::asio::buffer(msg.data(), msg.size());
-	boost::asio::async_write(
-		socket_, b,
-		[this](boost::system::error_code ec, size_t /*unused*/)
-		{
-			if(ec)
-			{
-				std::fprintf(stderr, "do_write_: %s.\n", ec.message().data());
-				return;
-			}
-			outgoing_.pop();
-			if(!outgoing_.empty())
-				do_write_();
-		});
+	boost::system::error_code ec;
+	if(!socket_.non_blocking())
+		socket_.non_blocking(true, ec);
+	auto const written = socket_.write_some(
+		boost::asio::buffer(msg.data(), msg.size()), ec);
+	// Anything that went wrong shows up again in the write loop.
+	return ec ? 0U : written;
 }
 
-auto Client::do_read_header_() noexcept -> void
+auto Client::write_loop_() noexcept -> boost::asio::awaitable<void>
 {
-	auto b = boost::asio::buffer(incoming_.header_data(),
-	                             YGOPro::STOCMsg::HEADER_SIZE);
-	boost::asio::async_read(
-		socket_, b,
-		[this](boost::system::error_code ec, size_t /*unused*/)
+	using AllocTracking::Phase;
+	auto const token = boost::asio::bind_allocator(
+		HandlerAllocator<std::byte>(write_memory_), AS_TUPLE_AWAITABLE);
+	for(;;)
+	{
+		if(pending_.empty())
 		{
-			if(ec)
+			if(writes_done_)
+				co_return;
+			// Idle clients don't need to hold on to whatever grew these.
+			// Not much of a loss: messages sent while the loop is idle go
+			// straight to the socket, so these are only refilled under
+			// backpressure or when several messages are sent during a write.
+			if(msg_pool_ != nullptr)
 			{
-				std::fprintf(stderr, "do_read_header_: %s.\n",
-			                 ec.message().data());
-				return;
+				pending_ = {};
+				in_flight_ = {};
 			}
-			do_read_body_();
-		});
+			// Woken up by send_msg_ (or finish_) cancelling the wait.
+			write_idle_ = true;
+			auto op = [&]() { return write_signal_.async_wait(token); };
+			co_await charged(Phase::WRITE, alloc_stats_, op);
+			write_idle_ = false;
+			continue;
+		}
+		// Everything queued while the previous write was in flight goes out in
+		// a single write.
+		std::swap(pending_, in_flight_);
+		pending_.clear();
+		auto const connection = connection_;
+		auto op = [&]()
+		{
+			return boost::asio::async_write(
+				socket_, boost::asio::buffer(in_flight_), token);
+		};
+		auto const [ec, _] = co_await charged(Phase::WRITE, alloc_stats_, op);
+		// Failed or not, what was written belonged to the old connection.
+		if(connection != connection_)
+			continue;
+		if(ec)
+		{
+			// Let the read side notice and decide whether to reconnect.
+			// NOTE: Errors after close() are just the cancellation.
+			if(!finished_)
+				std::fprintf(stderr, "write_loop_: %s.\n", ec.message().data());
+			boost::system::error_code ignored;
+			socket_.close(ignored);
+			pending_.clear();
+		}
+	}
 }
 
-auto Client::do_read_body_() noexcept -> void
+auto Client::read_msg_() noexcept -> ReadAwaitable
 {
-	// TODO: Check if following socket read would be too long to store and
-	// report accordingly.
-	auto b = boost::asio::buffer(incoming_.body_data(), incoming_.body_size());
-	boost::asio::async_read(
-		socket_, b,
-		[this](boost::system::error_code ec, size_t /*unused*/)
-		{
-			if(ec)
+	using AllocTracking::Phase;
+	using YGOPro::STOCMsg;
+	auto const token = boost::asio::bind_allocator(
+		HandlerAllocator<std::byte>(read_memory_), AS_TUPLE_AWAITABLE);
+	// Reads as much as the socket has at once and hands out one message per
+	// call, so bursts (such as the catch-up after a reconnect) take a handful
+	// of reads instead of two per message. A single composed operation rather
+	// than a coroutine: only one coroutine frame is alive while reading, which
+	// asio recycles, so reading doesn't allocate in the steady state.
+	enum class Step
+	{
+		START,
+		FILL,     // Reading into the read buffer.
+		REST,     // Reading the rest of a big message into incoming_.
+		DEFERRED, // Resumed through the executor.
+	};
+	// NOTE: Past the start, this runs from completion handlers, outside of
+	// the caller's allocation scopes, so it opens its own.
+	return boost::asio::async_compose<decltype(token),
+	                                  void(boost::system::error_code)>(
+		[this, step = Step::START](auto& self,
+		                           boost::system::error_code ec = {},
+		                           size_t n = 0U) mutable
+		{
+			if(step == Step::REST || (step == Step::FILL && ec))
 			{
-				std::fprintf(stderr, "do_read_body_: %s.\n",
-			                 ec.message().data());
+				self.complete(ec);
 				return;
 			}
-			if(handle_msg_())
-				do_read_header_();
-		});
+			if(step == Step::FILL)
+				read_end_ += n;
+			auto const available = read_end_ - read_begin_;
+			if(available >= STOCMsg::HEADER_SIZE)
+			{
+				STOCMsg::SizeType size{};
+				std::memcpy(&size, read_buffer_.data() + read_begin_,
+				            sizeof(size));
+				auto const frame_size = sizeof(size) + size;
+				auto const invalid =
+					size == 0U || frame_size > STOCMsg::MAX_LENGTH;
+				if(step == Step::START && (invalid || available >= frame_size))
+				{
+					// Completing from within the initiation would resume
+					// the coroutine recursively, go through the executor.
+					// Give the message buffer back meanwhile, other clients
+					// may run first.
+					if(msg_pool_ != nullptr)
+						incoming_.reset();
+					step = Step::DEFERRED;
+					boost::asio::post(socket_.get_executor(),
+					                  [self = std::move(self)]() mutable
+					                  { self(); });
+					return;
+				}
+				if(invalid)
+				{
+					std::fprintf(stderr,
+					             "read_msg_: Invalid message size %u.\n",
+					             static_cast<unsigned>(size));
+					ec = make_error_code(boost::system::errc::bad_message);
+				}
+				else if(!incoming_ && (available >= frame_size ||
+				                       frame_size > read_buffer_.size()))
+				{
+					auto acquire = [&]() { return msg_pool_->acquire(); };
+					incoming_ = charged(Phase::READ, alloc_stats_, acquire);
+				}
+				if(!ec && available >= frame_size)
+				{
+					std::memcpy(incoming_->header_data(),
+					            read_buffer_.data() + read_begin_, frame_size);
+					read_begin_ += frame_size;
+				}
+				else if(!ec && frame_size > read_buffer_.size())
+				{
+					// Doesn't fit in the (compact) read buffer: read the rest
+					// of the message straight into the message buffer.
+					std::memcpy(incoming_->header_data(),
+					            read_buffer_.data() + read_begin_, available);
+					read_begin_ = 0U;
+					read_end_ = 0U;
+					step = Step::REST;
+					auto b = boost::asio::buffer(
+						incoming_->header_data() + available,
+						frame_size - available);
+					auto read = [&]()
+					{
+						boost::asio::async_read(socket_, b, std::move(self));
+					};
+					charged(Phase::READ, alloc_stats_, read);
+					return;
+				}
+				if(ec || available >= frame_size)
+				{
+					self.complete(ec);
+					return;
+				}
+			}
+			// Nothing else to handle until more data comes, give the message
+			// buffer back while waiting.
+			if(msg_pool_ != nullptr)
+				incoming_.reset();
+			if(read_begin_ != 0U)
+			{
+				std::memmove(read_buffer_.data(),
+				             read_buffer_.data() + read_begin_, available);
+				read_begin_ = 0U;
+				read_end_ = available;
+			}
+			step = Step::FILL;
+			auto b = boost::asio::buffer(read_buffer_.data() + read_end_,
+			                             read_buffer_.size() - read_end_);
+			auto read = [&]() { socket_.async_read_some(b, std::move(self)); };
+			charged(Phase::READ, alloc_stats_, read);
+		},
+		token, socket_);
 }
 
-auto Client::handle_msg_() noexcept -> bool
+auto Client::run_() noexcept -> boost::asio::awaitable<void>
 {
-	using namespace YGOPro;
-	switch(incoming_.type())
+	if(co_await lobby_())
 	{
-	case STOCMsg::IdType::GAME_MSG:
-	{
-		analyze_(incoming_.body_data(), incoming_.body_size());
-		return true;
+		for(;;)
+		{
+			auto const status = co_await duel_();
+			if(status != Status::DISCONNECTED || !co_await reconnect_())
+				break;
+		}
 	}
-	case STOCMsg::IdType::ERROR_MSG:
+	AllocTracking::SinkScope sink(alloc_stats_);
+	finish_();
+}
+
+auto Client::reconnect_() noexcept -> boost::asio::awaitable<bool>
+{
+	using AllocTracking::Phase;
+	auto const token = boost::asio::bind_allocator(
+		HandlerAllocator<std::byte>(read_memory_), AS_TUPLE_AWAITABLE);
+	disconnected_at_ = std::chrono::steady_clock::now();
+	resuming_ = true;
+	// NOTE: After every wait, close() may have been called meanwhile, and
+	// then there's nothing left to reconnect for.
+	for(int attempt = 0; attempt < RECONNECT_ATTEMPTS && !finished_; attempt++)
 	{
-		if(incoming_.body_size() == sizeof(STOCMsg::Error))
+		if(attempt != 0)
 		{
-			auto const error = incoming_.as_fixed<STOCMsg::Error>();
-			std::fprintf(stderr, "Server reported error 0x%X and code %u.\n",
-			             error.msg, error.code);
+			reconnect_timer_.expires_after(RECONNECT_DELAY * attempt);
+			auto op = [&]() { return reconnect_timer_.async_wait(token); };
+			co_await charged(Phase::OTHER, alloc_stats_, op);
+			if(finished_)
+				break;
 		}
-		else // incoming_.body_size() == sizeof(STOCMsg::DeckError)
+		std::fprintf(stderr, "Reconnecting to room %u (attempt %i).\n",
+		             room_id_, attempt + 1);
+		// Whatever was queued or half read belongs to the old connection.
+		connection_++;
 		{
-			auto const deck_error = incoming_.as_fixed<STOCMsg::DeckError>();
-			std::fprintf(stderr, "Deck error 0x%X with code %u.\n",
-			             deck_error.msg, deck_error.code);
+			boost::system::error_code ignored;
+			socket_.close(ignored);
 		}
-		return false;
-	}
-	case STOCMsg::IdType::CHOOSE_RPS:
-	{
-		send_msg_(CTOSMsg::make_fixed(CTOSMsg::RPSChoice{1U}));
-		return true;
+		pending_.clear();
+		read_begin_ = 0U;
+		read_end_ = 0U;
+		auto op = [&]() { return socket_.async_connect(endpoint_, token); };
+		auto const [ec] = co_await charged(Phase::OTHER, alloc_stats_, op);
+		if(finished_)
+			break;
+		if(ec)
+		{
+			std::fprintf(stderr, "reconnect_: %s.\n", ec.message().data());
+			continue;
+		}
+		AllocTracking::SinkScope sink(alloc_stats_);
+		send_msg_(YGOPro::make_player_info());
+		send_msg_(YGOPro::make_join_game(room_id_));
+		co_return true;
 	}
-	case STOCMsg::IdType::CHOOSE_ORDER:
+	co_return false;
+}
+
+auto Client::lobby_() noexcept -> boost::asio::awaitable<bool>
+{
+	using namespace YGOPro;
+	using AllocTracking::Phase;
+	for(;;)
 	{
-		auto turn_choice = CTOSMsg::TurnChoice{0U};
-		if(auto const first = core_->wants_first_turn(); first.has_value())
+		auto op = [this]() { return read_msg_(); };
+		auto const [ec] = co_await charged(Phase::READ, alloc_stats_, op);
+		if(ec)
 		{
-			turn_choice.value = static_cast<uint8_t>(*first);
+			// NOTE: Errors after close() are just the cancellation. Malformed
+			// frames were already reported.
+			if(!finished_ && ec != boost::system::errc::bad_message)
+				std::fprintf(stderr, "read_msg_: %s.\n", ec.message().data());
+			co_return false;
 		}
-		else
+		// NOTE: Not kept across suspension points, other clients may run on
+		// this thread meanwhile.
+		AllocTracking::SinkScope sink(alloc_stats_);
+		switch(incoming_->type())
 		{
-			// Indifferent. Randomly decide.
-			// TODO.
+		case STOCMsg::IdType::ERROR_MSG:
+		{
+			print_error_();
+			co_return false;
+		}
+		case STOCMsg::IdType::CREATE_GAME:
+		{
+			room_id_ = incoming_->as_fixed<STOCMsg::CreateGame>().id;
+			if(on_room_created_ != nullptr)
+				on_room_created_(user_, room_id_);
+			break;
+		}
+		case STOCMsg::IdType::JOIN_GAME:
+		{
+			auto const join_game = incoming_->as_fixed<STOCMsg::JoinGame>();
+			t0_count_ = join_game.host_info.t0_count;
+			break;
+		}
+		case STOCMsg::IdType::TYPE_CHANGE:
+		{
+			auto const type_change = incoming_->as_fixed<STOCMsg::TypeChange>();
+			uint8_t index = (type_change.value & 0xFU); // NOLINT
+			if(index > 6U)                              // NOLINT
+			{
+				std::fprintf(stderr, "Room is full. Bailing out.\n");
+				co_return false;
+			}
+			team_ = static_cast<uint8_t>(index > t0_count_ - 1U);
+			duelist_ = (index > t0_count_ - 1U) ? index - t0_count_ : index;
+			{
+				auto msg = CTOSMsg::make_dynamic(CTOSMsg::IdType::UPDATE_DECK);
+				msg.write(static_cast<uint32_t>(deck_.size()));
+				msg.write<uint32_t>(0U); // No sidedeck for now.
+				for(auto card_code : deck_)
+					msg.write<uint32_t>(card_code);
+				send_msg_(msg);
+			}
+			send_msg_(CTOSMsg::make_fixed(CTOSMsg::Ready{}));
+			break;
+		}
+		case STOCMsg::IdType::PLAYER_CHANGE:
+		{
+			auto const player_change =
+				incoming_->as_fixed<STOCMsg::PlayerChange>();
+			bool const ready = (player_change.value & 0xFU) == 0x9U; // NOLINT
+			if(ready && hosting_)
+				send_msg_(CTOSMsg::make_fixed(CTOSMsg::TryStart{}));
+			break;
+		}
+		case STOCMsg::IdType::WATCH_CHANGE:
+		{
+			break;
+		}
+		case STOCMsg::IdType::DUEL_START:
+		{
+			start_duel_();
+			co_return true;
+		}
+		default:
+		{
+			print_unknown_();
+			break;
+		}
 		}
-		send_msg_(CTOSMsg::make_fixed(turn_choice));
-		return true;
-	}
-	case STOCMsg::IdType::JOIN_GAME:
-	{
-		auto const join_game = incoming_.as_fixed<STOCMsg::JoinGame>();
-		t0_count_ = join_game.host_info.t0_count;
-		return true;
 	}
-	case STOCMsg::IdType::TYPE_CHANGE:
+}
+
+auto Client::duel_() noexcept -> boost::asio::awaitable<Status>
+{
+	using namespace YGOPro;
+	using AllocTracking::Phase;
+	for(;;)
 	{
-		auto const type_change = incoming_.as_fixed<STOCMsg::TypeChange>();
-		uint8_t index = (type_change.value & 0xFU); // NOLINT
-		if(index > 6U)                              // NOLINT
+		auto op = [this]() { return read_msg_(); };
+		auto const [ec] = co_await charged(Phase::READ, alloc_stats_, op);
+		if(ec)
 		{
-			std::fprintf(stderr, "Room is full. Bailing out.\n");
-			return false;
+			// A server sending malformed frames won't do better if we
+			// reconnect, give up instead.
+			if(ec == boost::system::errc::bad_message)
+				co_return Status::FAILED;
+			// NOTE: Errors after close() are just the cancellation.
+			if(!finished_)
+				std::fprintf(stderr, "read_msg_: %s.\n", ec.message().data());
+			co_return Status::DISCONNECTED;
 		}
-		team_ = static_cast<uint8_t>(index > t0_count_ - 1U);
-		duelist_ = (index > t0_count_ - 1U) ? index - t0_count_ : index;
+		AllocTracking::SinkScope sink(alloc_stats_);
+		switch(incoming_->type())
 		{
-			auto msg = CTOSMsg::make_dynamic(CTOSMsg::IdType::UPDATE_DECK);
-			msg.write(static_cast<uint32_t>(deck_.size()));
-			msg.write<uint32_t>(0U); // No sidedeck for now.
-			for(auto card_code : deck_)
-				msg.write<uint32_t>(card_code);
-			send_msg_(msg);
+		case STOCMsg::IdType::GAME_MSG:
+		{
+			if(catching_up_)
+				catch_up_(incoming_->body_data(), incoming_->body_size());
+			else
+				analyze_(incoming_->body_data(), incoming_->body_size());
+			break;
+		}
+		case STOCMsg::IdType::ERROR_MSG:
+		{
+			print_error_();
+			co_return Status::FAILED;
+		}
+		case STOCMsg::IdType::CHOOSE_RPS:
+		{
+			send_msg_(CTOSMsg::make_fixed(CTOSMsg::RPSChoice{1U}));
+			break;
+		}
+		case STOCMsg::IdType::CHOOSE_ORDER:
+		{
+			auto turn_choice = CTOSMsg::TurnChoice{0U};
+			if(auto const first = core_ ? core_->wants_first_turn()
+			                            : std::optional<bool>{};
+			   first.has_value())
+			{
+				turn_choice.value = static_cast<uint8_t>(*first);
+			}
+			else
+			{
+				// Indifferent. Randomly decide.
+				// TODO.
+			}
+			send_msg_(CTOSMsg::make_fixed(turn_choice));
+			break;
+		}
+		case STOCMsg::IdType::DUEL_START:
+		{
+			// Next duel of a match or rematch, unless we are rejoining the
+			// current one.
+			if(!resuming_)
+				start_duel_();
+			break;
+		}
+		case STOCMsg::IdType::CATCHUP:
+		{
+			if(incoming_->as_fixed<STOCMsg::Catchup>().catching_up != 0U)
+				begin_catch_up_();
+			else
+				end_catch_up_();
+			break;
+		}
+		case STOCMsg::IdType::DUEL_END:
+		{
+			end_duel_();
+			co_return Status::OK;
+		}
+		case STOCMsg::IdType::REMATCH:
+		{
+			send_msg_(CTOSMsg::make_fixed(CTOSMsg::Rematch{1U}));
+			break;
+		}
+		case STOCMsg::IdType::JOIN_GAME:
+		{
+			// Only sent when rejoining.
+			auto const join_game = incoming_->as_fixed<STOCMsg::JoinGame>();
+			t0_count_ = join_game.host_info.t0_count;
+			break;
+		}
+		case STOCMsg::IdType::TYPE_CHANGE:
+		{
+			// Only sent when rejoining. The Core plays the seat we had, any
+			// other (or watching) can't resume the duel.
+			auto const type_change = incoming_->as_fixed<STOCMsg::TypeChange>();
+			uint8_t const index = (type_change.value & 0xFU); // NOLINT
+			auto const seat = static_cast<uint8_t>(
+				team_ != 0U ? t0_count_ + duelist_ : duelist_);
+			if(index != seat)
+			{
+				std::fprintf(stderr,
+				             "Rejoined room %u in another seat. Bailing out.\n",
+				             room_id_);
+				co_return Status::FAILED;
+			}
+			break;
+		}
+		case STOCMsg::IdType::ORDER_RESULT:
+		case STOCMsg::IdType::PLAYER_CHANGE:
+		case STOCMsg::IdType::WATCH_CHANGE:
+		{
+			break;
+		}
+		default:
+		{
+			print_unknown_();
+			break;
+		}
 		}
-		send_msg_(CTOSMsg::make_fixed(CTOSMsg::Ready{}));
-		return true;
 	}
-	case STOCMsg::IdType::DUEL_START:
-	{
-		core_ = std::make_unique<Deskbot::Core>(
-			Deskbot::Core::Options{log_cb, nullptr, load_script, nullptr});
-		core_->process_script(script_, load_script(nullptr, script_));
-		core_->call_initialize();
-		ctx_ = std::make_unique<YGOpen::Server::BasicEncodeContext>();
-		return true;
+}
+
+auto Client::make_core_() noexcept -> void
+{
+	core_ = std::make_unique<Deskbot::Core>(
+		Deskbot::Core::Options{log_cb, nullptr, load_script, nullptr});
+	auto const script = load_script(nullptr, script_);
+	core_->process_script(script_, script);
+	core_->call_initialize();
+	try
+	{
+		subscriptions_ = parse_script_directives(script).subscribe;
 	}
-	case STOCMsg::IdType::DUEL_END:
+	catch(std::exception const& e)
 	{
-		std::printf("All duels ended. Good Bye!\n");
-		return false;
+		std::fprintf(stderr, "Ignoring script directives: %s\n", e.what());
+		subscriptions_.set();
 	}
-	case STOCMsg::IdType::PLAYER_CHANGE:
+	ctx_ = std::make_unique<YGOpen::Server::BasicEncodeContext>();
+}
+
+auto Client::start_duel_() noexcept -> void
+{
+	end_export_();
+	make_core_();
+	msg_counters_ = std::make_unique<MsgCounters>();
+	if(!result_)
+		result_ = std::make_unique<Result>();
+	*result_ = {Result::Outcome::ABORTED, 0U, {}, {}};
+	duel_id_ = next_duel_id.fetch_add(1U, std::memory_order_relaxed);
+	exporting_ = dataset_ != nullptr;
+	alloc_stats_ = {};
+	duel_started_ = std::chrono::steady_clock::now();
+}
+
+auto Client::begin_catch_up_() noexcept -> void
+{
+	// The whole duel is replayed from the start: rebuild everything from
+	// scratch, but only the encoding context learns from the history.
+	make_core_();
+	// What was missed while disconnected is only replayed to the encoding
+	// context, the exported duel would have a gap.
+	if(exporting_)
 	{
-		auto const player_change = incoming_.as_fixed<STOCMsg::PlayerChange>();
-		bool const ready = (player_change.value & 0xFU) == 0x9U; // NOLINT
-		if(ready && hosting_)
-			send_msg_(CTOSMsg::make_fixed(CTOSMsg::TryStart{}));
-		return true;
+		dataset_->truncate(duel_id_);
+		exporting_ = false;
 	}
-	case STOCMsg::IdType::REMATCH:
+	catching_up_ = true;
+	replayed_msgs_ = 0U;
+	result_->turns = 0U;
+	deferred_request_.clear();
+}
+
+auto Client::end_catch_up_() noexcept -> void
+{
+	using namespace std::chrono;
+	catching_up_ = false;
+	resuming_ = false;
+	std::printf("Resumed duel in room %u after %.1fms, %llu messages "
+	            "replayed.\n",
+	            room_id_,
+	            duration<double, std::milli>(steady_clock::now() -
+	                                         disconnected_at_)
+	                .count(),
+	            static_cast<unsigned long long>(replayed_msgs_));
+	// The last message of the history was a request still waiting for us.
+	if(!deferred_request_.empty())
 	{
-		send_msg_(CTOSMsg::make_fixed(CTOSMsg::Rematch{1U}));
-		return true;
+		auto const request = std::move(deferred_request_);
+		deferred_request_.clear();
+		analyze_(request.data(), request.size());
 	}
-	default:
+}
+
+auto Client::catch_up_(uint8_t const* buffer, size_t size) noexcept -> void
+{
+	// A request is only live if nothing follows it in the history, so hold
+	// it until the next message (or the end of the catch-up) tells.
+	if(!deferred_request_.empty())
 	{
-		std::printf("Unknown message 0x%X, with size %i.\n",
-		            static_cast<unsigned int>(incoming_.type()),
-		            incoming_.body_size());
-		return true;
+		replay_(deferred_request_.data(), deferred_request_.size());
+		deferred_request_.clear();
 	}
+	if(size != 0U && YGOPro::is_request(static_cast<YGOPro::CoreMsg>(*buffer)))
+		deferred_request_.assign(buffer, buffer + size);
+	else
+		replay_(buffer, size);
+}
+
+auto Client::replay_(uint8_t const* buffer, size_t size) noexcept -> void
+{
+	using namespace YGOpen::Codec;
+	using YGOPro::CoreMsg;
+	if(size == 0U)
+		return;
+	if(auto const msg = static_cast<CoreMsg>(*buffer);
+	   msg == CoreMsg::RETRY || msg == CoreMsg::WAITING)
+		return;
+	track_result_(buffer, size);
+	google::protobuf::Arena arena;
+	auto const r = [&]()
+	{
+		AllocTracking::PhaseScope phase(AllocTracking::Phase::ENCODE);
+		return Edo9300::OCGCore::encode_one(arena, *ctx_, buffer);
+	}();
+	if(r.state == EncodeOneResult::State::OK)
+	{
+		AllocTracking::PhaseScope phase(AllocTracking::Phase::ENCODE);
+		ctx_->parse(*r.msg);
+		replayed_msgs_++;
 	}
+	else if(r.state == EncodeOneResult::State::UNKNOWN)
+	{
+		std::fprintf(stderr, "Regular encoding failed: %i.\n",
+		             static_cast<int>(*buffer));
+	}
+}
+
+auto Client::end_duel_() noexcept -> void
+{
+	end_export_();
+	resuming_ = false;
+	print_msg_counters_();
+	AllocTracking::print("Duel", alloc_stats_);
+	if(answer_cache_ != nullptr)
+	{
+		// Counted since the cache was created, not just for this duel.
+		auto const stats = answer_cache_->stats();
+		auto const lookups = stats.hits + stats.misses;
+		auto const hits = static_cast<double>(stats.hits);
+		auto const hit_rate =
+			lookups != 0U ? 100.0 * hits / static_cast<double>(lookups) : 0.0;
+		auto const saved = std::chrono::duration<double, std::milli>(
+			answer_cache_->time_saved());
+		std::printf("Answer cache totals: %llu hits out of %llu lookups "
+		            "(%.1f%%), %.2fms saved.\n",
+		            static_cast<unsigned long long>(stats.hits),
+		            static_cast<unsigned long long>(lookups), hit_rate,
+		            saved.count());
+	}
+	std::printf("All duels ended. Good Bye!\n");
+	// Nothing else needs these until the next duel, if any.
+	core_.reset();
+	ctx_.reset();
+	msg_counters_.reset();
+}
+
+auto Client::print_error_() const noexcept -> void
+{
+	using YGOPro::STOCMsg;
+	if(incoming_->body_size() == sizeof(STOCMsg::Error))
+	{
+		auto const error = incoming_->as_fixed<STOCMsg::Error>();
+		std::fprintf(stderr, "Server reported error 0x%X and code %u.\n",
+		             error.msg, error.code);
+	}
+	else // incoming_->body_size() == sizeof(STOCMsg::DeckError)
+	{
+		auto const deck_error = incoming_->as_fixed<STOCMsg::DeckError>();
+		std::fprintf(stderr, "Deck error 0x%X with code %u.\n", deck_error.msg,
+		             deck_error.code);
+	}
+}
+
+auto Client::print_unknown_() const noexcept -> void
+{
+	std::printf("Unknown message 0x%X, with size %i.\n",
+	            static_cast<unsigned int>(incoming_->type()),
+	            incoming_->body_size());
+}
+
+auto Client::end_export_() noexcept -> void
+{
+	if(dataset_ != nullptr && ctx_)
+		dataset_->end_stream(duel_id_);
 }
 
 auto Client::analyze_(uint8_t const* buffer, size_t size) noexcept -> void
 {
-	auto analyze_and_answer = [&](YGOpen::Proto::Duel::Msg const& msg)
+	auto const received = std::chrono::steady_clock::now();
+	using AllocTracking::Phase;
+	using AllocTracking::PhaseScope;
+	using YGOpen::Proto::Duel::Answer;
+	auto analyze_and_answer =
+		[&](google::protobuf::Arena& arena,
+	        YGOpen::Proto::Duel::Msg const& msg) -> Answer const*
 	{
-		ctx_->parse(msg);
-		core_->analyze(msg);
+		{
+			PhaseScope phase(Phase::ENCODE);
+			ctx_->parse(msg);
+		}
 		if(msg.t_case() != YGOpen::Proto::Duel::Msg::kRequest)
-			return;
+		{
+			if(subscriptions_.test(*buffer))
+			{
+				msg_counters_->analyzed[*buffer]++;
+				PhaseScope phase(Phase::ANALYZE);
+				core_->analyze(msg);
+			}
+			else
+			{
+				msg_counters_->skipped[*buffer]++;
+			}
+			return nullptr;
+		}
+		msg_counters_->analyzed[*buffer]++;
 		auto const& req = msg.request();
-		auto const answer = core_->answer(req);
-		using namespace YGOpen::Codec;
-		Edo9300::OCGCore::decode_one_answer(req, answer, answer_buffer_);
+		auto* answer = google::protobuf::Arena::CreateMessage<Answer>(&arena);
+		bool const memoize =
+			answer_cache_ != nullptr && answer_cache_->memoizes(*buffer);
+		if(!memoize ||
+		   !answer_cache_->find(buffer, size, dataset_ ? answer : nullptr,
+		                        answer_buffer_))
+		{
+			auto const start = std::chrono::steady_clock::now();
+			{
+				PhaseScope phase(Phase::ANALYZE);
+				core_->analyze(msg);
+			}
+			{
+				PhaseScope phase(Phase::ANSWER);
+				*answer = core_->answer(req);
+			}
+			{
+				PhaseScope phase(Phase::DECODE);
+				using namespace YGOpen::Codec;
+				Edo9300::OCGCore::decode_one_answer(req, *answer,
+				                                    answer_buffer_);
+			}
+			if(memoize)
+				answer_cache_->insert(buffer, size, *answer, answer_buffer_,
+				                      std::chrono::steady_clock::now() - start);
+		}
 		assert(!answer_buffer_.empty());
 		auto ctosmsg = YGOPro::CTOSMsg::make_dynamic(YGOPro::CTOSMsg::RESPONSE);
 		ctosmsg.write(answer_buffer_.data(), answer_buffer_.size());
 		send_msg_(ctosmsg);
+		result_->decision_latency.record(std::chrono::steady_clock::now() -
+		                                 received);
+		return answer;
 	};
 	// NOTE: Assuming the server is sending one game message at the time.
-	google::protobuf::Arena arena;
 	using namespace YGOpen::Codec;
 	uint8_t const core_msg = *buffer;
 	assert(core_msg != 1U); // NOLINT: MSG_RETRY
 	if(core_msg == 3U)      // NOLINT: MSG_WAITING
 		return;
-	auto const r = Edo9300::OCGCore::encode_one(arena, *ctx_, buffer);
+	track_result_(buffer, size);
+	// When exporting, the arena is handed over to the dataset writer along
+	// with the messages in it, so it can't live in the stack.
+	google::protobuf::Arena local_arena;
+	auto& arena = exporting_ ? dataset_arena_.get() : local_arena;
+	auto const r = [&]()
+	{
+		PhaseScope phase(Phase::ENCODE);
+		return Edo9300::OCGCore::encode_one(arena, *ctx_, buffer);
+	}();
 	switch(r.state)
 	{
 	case EncodeOneResult::State::OK:
 	{
-		analyze_and_answer(*r.msg);
+		auto const* answer = analyze_and_answer(arena, *r.msg);
+		// The writer drops the rest of a duel that lost a record, don't
+		// bother allocating arenas for it.
+		if(exporting_)
+			exporting_ = dataset_->push(RecordWriter::Record{
+				duel_id_, dataset_arena_.use(), r.msg, answer});
 		break;
 	}
 	case EncodeOneResult::State::UNKNOWN:
@@ -299,3 +899,90 @@ auto Client::analyze_(uint8_t const* buffer, size_t size) noexcept -> void
 	}
 	assert(r.bytes_read == size);
 }
+
+auto Client::track_result_(uint8_t const* buffer, size_t size) noexcept
+	-> void
+{
+	using YGOPro::CoreMsg;
+	switch(static_cast<CoreMsg>(*buffer))
+	{
+	case CoreMsg::START:
+	{
+		// The server fills the player type byte with the core player each
+		// team plays as, and marks observers in the high nibble.
+		if(size > 1U)
+			player_ = buffer[1U] & 0xFU; // NOLINT
+		break;
+	}
+	case CoreMsg::NEW_TURN:
+	{
+		result_->turns++;
+		break;
+	}
+	case CoreMsg::WIN:
+	{
+		if(size <= 1U)
+			break;
+		using Outcome = Result::Outcome;
+		if(buffer[1U] == 2U) // NOLINT: PLAYER_NONE
+			result_->outcome = Outcome::DRAW;
+		else
+			result_->outcome =
+				buffer[1U] == player_ ? Outcome::WIN : Outcome::LOSS;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+auto Client::finish_() noexcept -> void
+{
+	if(finished_)
+		return;
+	finished_ = true;
+	// Let the write loop flush what's queued and return.
+	writes_done_ = true;
+	write_signal_.cancel();
+	if(on_finished_ == nullptr)
+		return;
+	if(result_)
+	{
+		result_->duration = std::chrono::steady_clock::now() - duel_started_;
+		on_finished_(user_, *result_);
+	}
+	else
+	{
+		// Never got to start a duel.
+		on_finished_(user_, Result{Result::Outcome::ABORTED, 0U, {}, {}});
+	}
+}
+
+auto Client::print_msg_counters_() const noexcept -> void
+{
+	if(!msg_counters_)
+		return;
+	auto const& [analyzed_msgs, skipped_msgs] = *msg_counters_;
+	uint64_t analyzed = 0U;
+	uint64_t skipped = 0U;
+	for(size_t i = 0U; i < skipped_msgs.size(); i++)
+	{
+		analyzed += analyzed_msgs[i];
+		skipped += skipped_msgs[i];
+	}
+	if(skipped == 0U)
+		return;
+	std::printf("Skipped analysis of %llu out of %llu messages:",
+	            static_cast<unsigned long long>(skipped),
+	            static_cast<unsigned long long>(analyzed + skipped));
+	for(size_t i = 0U; i < skipped_msgs.size(); i++)
+	{
+		if(skipped_msgs[i] == 0U)
+			continue;
+		auto const msg = static_cast<YGOPro::CoreMsg>(i);
+		auto const name = YGOPro::core_msg_name(msg);
+		std::printf(" %.*s=%llu", static_cast<int>(name.size()), name.data(),
+		            static_cast<unsigned long long>(skipped_msgs[i]));
+	}
+	std::printf(".\n");
+}
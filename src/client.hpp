@@ -5,12 +5,23 @@
  */
 #ifndef EDOPRO_DESKBOT_CLIENT_HPP
 #define EDOPRO_DESKBOT_CLIENT_HPP
+#include <array>
+#include <boost/asio/awaitable.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
 #include <memory>
-#include <queue>
 #include <string_view>
+#include <tuple>
+#include <vector>
 
+#include "alloc_tracking.hpp"
+#include "buffer_pool.hpp"
 #include "ctosmsg.hpp"
+#include "handler_memory.hpp"
+#include "histogram.hpp"
+#include "record_writer.hpp"
+#include "script_directives.hpp"
 #include "stocmsg.hpp"
 
 namespace Deskbot
@@ -27,14 +38,63 @@ class BasicEncodeContext;
 
 } // namespace YGOpen::Server
 
+class AnswerCache;
+
 class Client
 {
+	enum class Status : uint8_t
+	{
+		OK,
+		DISCONNECTED,
+		FAILED, // Server error, no point in retrying.
+	};
+
 public:
+	struct Result
+	{
+		enum class Outcome : uint8_t
+		{
+			WIN,
+			LOSS,
+			DRAW,
+			ABORTED, // Connection or server error before the duel ended.
+		};
+
+		Outcome outcome;
+		uint32_t turns;
+		std::chrono::steady_clock::duration duration;
+		// Time from receiving a request to sending its answer.
+		LatencyHistogram decision_latency;
+	};
+
+	// Called from the thread running the client's io_context.
+	using RoomCreatedCallback = void (*)(void* user, uint32_t room_id) noexcept;
+	using FinishedCallback =
+		void (*)(void* user, Result const& result) noexcept;
+
 	struct Options
 	{
 		uint32_t const* deck_ptr;
 		size_t deck_size;
 		std::string_view script;
+		// If set, every decoded message and the answer given to it are
+		// streamed here as training data.
+		RecordWriter* dataset;
+		// If set, answers to requests the script declared deterministic are
+		// looked up here before asking the Core.
+		AnswerCache* answer_cache;
+		// Room to join, or 0 to host a new one.
+		uint32_t room_id;
+		// Optional, passed back as is to the callbacks below.
+		void* user;
+		// Optional, called once the server created the room we host.
+		RoomCreatedCallback on_room_created;
+		// Optional, called once when the duel ends or the client stops.
+		FinishedCallback on_finished;
+		// If set, the client runs in compact mode: it keeps a small read
+		// buffer and only borrows a message buffer from here while handling
+		// a message, so idle clients take a few KB each.
+		BufferPool<YGOPro::STOCMsg>* msg_pool;
 	};
 
 	Client(boost::asio::ip::tcp::socket socket, Options const& options);
@@ -45,31 +105,114 @@ public:
 	auto operator=(const Client&) -> Client& = delete;
 	auto operator=(Client&&) noexcept -> Client& = delete;
 
+	// Cancels everything the client is waiting on without calling back.
+	// Run the io_context until it's out of work afterwards, so the pending
+	// operations complete before the client is destroyed.
+	auto close() noexcept -> void;
+
 private:
-	YGOPro::STOCMsg incoming_;
-	std::queue<YGOPro::CTOSMsg> outgoing_;
+	// Only allocated while a duel goes on.
+	struct MsgCounters
+	{
+		std::array<uint64_t, 256U> analyzed;
+		std::array<uint64_t, 256U> skipped;
+	};
+
+	BufferPool<YGOPro::STOCMsg>* msg_pool_;
+	BufferPool<YGOPro::STOCMsg>::Lease incoming_;
+	// Messages are appended to pending_ while in_flight_ is being written.
+	std::vector<uint8_t> pending_;
+	std::vector<uint8_t> in_flight_;
 	boost::asio::ip::tcp::socket socket_;
+	boost::asio::ip::tcp::endpoint endpoint_; // To reconnect to.
+	// Never expires; cancelled to wake up the write loop.
+	boost::asio::steady_timer write_signal_;
+	bool write_idle_; // The write loop waits on write_signal_.
+	bool writes_done_;
+	// Delays reconnection attempts. A member so close() can cancel it.
+	boost::asio::steady_timer reconnect_timer_;
+	// The read and write loops have one operation in flight each at most,
+	// so their handlers always fit in these.
+	HandlerMemory read_memory_;
+	HandlerMemory write_memory_;
+	std::vector<uint8_t> read_buffer_;
+	size_t read_begin_;
+	size_t read_end_;
+	// Bumped on every reconnection, so writes started on the old socket
+	// don't touch the new buffers.
+	uint32_t connection_;
 
 	std::vector<uint32_t> deck_;
+	uint32_t room_id_;
 	bool hosting_;
 	uint8_t t0_count_;
 	uint8_t team_;
 	uint8_t duelist_;
 
 	std::string_view script_;
+	RecordWriter* dataset_;
+	AnswerCache* answer_cache_;
+	uint64_t duel_id_;
+	bool exporting_; // Until the writer drops a record of this duel.
+	RecordArena dataset_arena_;
+
+	void* user_;
+	RoomCreatedCallback on_room_created_;
+	FinishedCallback on_finished_;
+	uint8_t player_; // Our player in the core, from MSG_START.
+	bool finished_;
+	bool resuming_;    // Rejoined mid-duel, waiting for the catch-up.
+	bool catching_up_; // Receiving the history of the duel.
+	uint64_t replayed_msgs_;
+	std::vector<uint8_t> deferred_request_;
+	std::chrono::steady_clock::time_point disconnected_at_;
+	std::chrono::steady_clock::time_point duel_started_;
+	std::unique_ptr<Result> result_; // From the first duel on.
+
+	// Messages the script didn't subscribe to skip the Core; count them.
+	ScriptDirectives::CoreMsgSet subscriptions_;
+	std::unique_ptr<MsgCounters> msg_counters_;
+
+	// Allocations made on behalf of this client, reset every duel.
+	AllocTracking::Sink alloc_stats_;
 
 	std::vector<uint8_t> answer_buffer_;
 	std::unique_ptr<Deskbot::Core> core_;
 	std::unique_ptr<YGOpen::Server::BasicEncodeContext> ctx_;
 
 	auto send_msg_(YGOPro::CTOSMsg msg) noexcept -> void;
-	auto do_write_() noexcept -> void;
-
-	auto do_read_header_() noexcept -> void;
-	auto do_read_body_() noexcept -> void;
-
-	auto handle_msg_() noexcept -> bool;
+	auto write_loop_() noexcept -> boost::asio::awaitable<void>;
+	// Sends what the socket takes without blocking, returns how much.
+	auto write_now_(YGOPro::CTOSMsg const& msg) noexcept -> size_t;
+
+	// Reads a whole message into incoming_, borrowing it from the pool in
+	// compact mode.
+	using ReadAwaitable =
+		boost::asio::awaitable<std::tuple<boost::system::error_code>>;
+	auto read_msg_() noexcept -> ReadAwaitable;
+
+	auto run_() noexcept -> boost::asio::awaitable<void>;
+	// False if the connection or the server failed.
+	auto lobby_() noexcept -> boost::asio::awaitable<bool>;
+	auto duel_() noexcept -> boost::asio::awaitable<Status>;
+	// Connects again and rejoins the room. False if every attempt failed.
+	auto reconnect_() noexcept -> boost::asio::awaitable<bool>;
+
+	auto make_core_() noexcept -> void;
+	auto start_duel_() noexcept -> void;
+	auto begin_catch_up_() noexcept -> void;
+	auto end_catch_up_() noexcept -> void;
+	auto catch_up_(uint8_t const* buffer, size_t size) noexcept -> void;
+	// Updates the encoding context with a message from the duel's history.
+	auto replay_(uint8_t const* buffer, size_t size) noexcept -> void;
+	auto end_duel_() noexcept -> void;
+	auto end_export_() noexcept -> void;
+	auto print_error_() const noexcept -> void;
+	auto print_unknown_() const noexcept -> void;
 	auto analyze_(uint8_t const* buffer, size_t size) noexcept -> void;
+	auto track_result_(uint8_t const* buffer, size_t size) noexcept -> void;
+	auto finish_() noexcept -> void;
+	auto print_msg_counters_() const noexcept -> void;
 };
 
 #endif // EDOPRO_DESKBOT_CLIENT_HPP
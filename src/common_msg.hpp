@@ -51,6 +51,29 @@ struct HostInfo
 	DeckLimits limits;
 };
 
+constexpr uint32_t HANDSHAKE = 4043399681U;
+constexpr auto CLIENT_VERSION = ClientVersion{{40U, 1U}, {10U, 0U}};
+constexpr uint64_t DUEL_FLAGS = 4295157760U;
+
+constexpr auto default_host_info() noexcept -> HostInfo
+{
+	auto hi = HostInfo{};
+	hi.banlist_hash = 0U;
+	hi.allowed = 0x3U; // "OCG/TCG"
+	hi.starting_draw_count = 5U;
+	hi.dont_check_deck_content = 1U;
+	hi.dont_shuffle_deck = 0U;
+	hi.draw_count_per_turn = 1U;
+	hi.duel_flags_high = DUEL_FLAGS >> 32U;
+	hi.handshake = HANDSHAKE;
+	hi.version = CLIENT_VERSION;
+	hi.duel_flags_low = DUEL_FLAGS & 0xFFFFFFFFU;
+	hi.limits.main = {40U, 60U};
+	hi.limits.side = {0U, 15U};
+	hi.limits.extra = {0U, 15U};
+	return hi;
+}
+
 } // namespace YGOPro
 
 #endif // EDOPRO_DESKBOT_COMMON_MSG_HPP
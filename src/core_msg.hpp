@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_CORE_MSG_HPP
+#define EDOPRO_DESKBOT_CORE_MSG_HPP
+#include <array>
+#include <cstdint> // uint8_t
+#include <optional>
+#include <string_view>
+#include <utility> // std::pair
+
+namespace YGOPro
+{
+
+// First byte of every GAME_MSG body, as written by edo9300's ocgcore.
+enum class CoreMsg : uint8_t
+{
+	RETRY = 1,
+	HINT = 2,
+	WAITING = 3,
+	START = 4,
+	WIN = 5,
+	UPDATE_DATA = 6,
+	UPDATE_CARD = 7,
+	REQUEST_DECK = 8,
+	SELECT_BATTLECMD = 10,
+	SELECT_IDLECMD = 11,
+	SELECT_EFFECTYN = 12,
+	SELECT_YESNO = 13,
+	SELECT_OPTION = 14,
+	SELECT_CARD = 15,
+	SELECT_CHAIN = 16,
+	SELECT_PLACE = 18,
+	SELECT_POSITION = 19,
+	SELECT_TRIBUTE = 20,
+	SORT_CHAIN = 21,
+	SELECT_COUNTER = 22,
+	SELECT_SUM = 23,
+	SELECT_DISFIELD = 24,
+	SORT_CARD = 25,
+	SELECT_UNSELECT_CARD = 26,
+	CONFIRM_DECKTOP = 30,
+	CONFIRM_CARDS = 31,
+	SHUFFLE_DECK = 32,
+	SHUFFLE_HAND = 33,
+	REFRESH_DECK = 34,
+	SWAP_GRAVE_DECK = 35,
+	SHUFFLE_SET_CARD = 36,
+	REVERSE_DECK = 37,
+	DECK_TOP = 38,
+	SHUFFLE_EXTRA = 39,
+	NEW_TURN = 40,
+	NEW_PHASE = 41,
+	CONFIRM_EXTRATOP = 42,
+	MOVE = 50,
+	POS_CHANGE = 53,
+	SET = 54,
+	SWAP = 55,
+	FIELD_DISABLED = 56,
+	SUMMONING = 60,
+	SUMMONED = 61,
+	SPSUMMONING = 62,
+	SPSUMMONED = 63,
+	FLIPSUMMONING = 64,
+	FLIPSUMMONED = 65,
+	CHAINING = 70,
+	CHAINED = 71,
+	CHAIN_SOLVING = 72,
+	CHAIN_SOLVED = 73,
+	CHAIN_END = 74,
+	CHAIN_NEGATED = 75,
+	CHAIN_DISABLED = 76,
+	CARD_SELECTED = 80,
+	RANDOM_SELECTED = 81,
+	BECOME_TARGET = 83,
+	DRAW = 90,
+	DAMAGE = 91,
+	RECOVER = 92,
+	EQUIP = 93,
+	LPUPDATE = 94,
+	UNEQUIP = 95,
+	CARD_TARGET = 96,
+	CANCEL_TARGET = 97,
+	PAY_LPCOST = 100,
+	ADD_COUNTER = 101,
+	REMOVE_COUNTER = 102,
+	ATTACK = 110,
+	BATTLE = 111,
+	ATTACK_DISABLED = 112,
+	DAMAGE_STEP_START = 113,
+	DAMAGE_STEP_END = 114,
+	MISSED_EFFECT = 120,
+	BE_CHAIN_TARGET = 121,
+	CREATE_RELATION = 122,
+	RELEASE_RELATION = 123,
+	TOSS_COIN = 130,
+	TOSS_DICE = 131,
+	ROCK_PAPER_SCISSORS = 132,
+	HAND_RES = 133,
+	ANNOUNCE_RACE = 140,
+	ANNOUNCE_ATTRIB = 141,
+	ANNOUNCE_CARD = 142,
+	ANNOUNCE_NUMBER = 143,
+	CARD_HINT = 160,
+	TAG_SWAP = 161,
+	RELOAD_FIELD = 162,
+	AI_NAME = 163,
+	SHOW_HINT = 164,
+	PLAYER_HINT = 165,
+	MATCH_KILL = 170,
+	CUSTOM_MSG = 180,
+	REMOVE_CARDS = 190,
+};
+
+// Whether the message expects an answer from the player it was sent to.
+constexpr auto is_request(CoreMsg msg) noexcept -> bool
+{
+	switch(msg)
+	{
+	case CoreMsg::SELECT_BATTLECMD:
+	case CoreMsg::SELECT_IDLECMD:
+	case CoreMsg::SELECT_EFFECTYN:
+	case CoreMsg::SELECT_YESNO:
+	case CoreMsg::SELECT_OPTION:
+	case CoreMsg::SELECT_CARD:
+	case CoreMsg::SELECT_CHAIN:
+	case CoreMsg::SELECT_PLACE:
+	case CoreMsg::SELECT_POSITION:
+	case CoreMsg::SELECT_TRIBUTE:
+	case CoreMsg::SORT_CHAIN:
+	case CoreMsg::SELECT_COUNTER:
+	case CoreMsg::SELECT_SUM:
+	case CoreMsg::SELECT_DISFIELD:
+	case CoreMsg::SORT_CARD:
+	case CoreMsg::SELECT_UNSELECT_CARD:
+	case CoreMsg::ROCK_PAPER_SCISSORS:
+	case CoreMsg::ANNOUNCE_RACE:
+	case CoreMsg::ANNOUNCE_ATTRIB:
+	case CoreMsg::ANNOUNCE_CARD:
+	case CoreMsg::ANNOUNCE_NUMBER:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Names used to refer to core messages in scripts and reports.
+constexpr std::array<std::pair<std::string_view, CoreMsg>, 95U>
+	CORE_MSG_NAMES = {{
+	{"retry", CoreMsg::RETRY},
+	{"hint", CoreMsg::HINT},
+	{"waiting", CoreMsg::WAITING},
+	{"start", CoreMsg::START},
+	{"win", CoreMsg::WIN},
+	{"update_data", CoreMsg::UPDATE_DATA},
+	{"update_card", CoreMsg::UPDATE_CARD},
+	{"request_deck", CoreMsg::REQUEST_DECK},
+	{"select_battlecmd", CoreMsg::SELECT_BATTLECMD},
+	{"select_idlecmd", CoreMsg::SELECT_IDLECMD},
+	{"select_effectyn", CoreMsg::SELECT_EFFECTYN},
+	{"select_yesno", CoreMsg::SELECT_YESNO},
+	{"select_option", CoreMsg::SELECT_OPTION},
+	{"select_card", CoreMsg::SELECT_CARD},
+	{"select_chain", CoreMsg::SELECT_CHAIN},
+	{"select_place", CoreMsg::SELECT_PLACE},
+	{"select_position", CoreMsg::SELECT_POSITION},
+	{"select_tribute", CoreMsg::SELECT_TRIBUTE},
+	{"sort_chain", CoreMsg::SORT_CHAIN},
+	{"select_counter", CoreMsg::SELECT_COUNTER},
+	{"select_sum", CoreMsg::SELECT_SUM},
+	{"select_disfield", CoreMsg::SELECT_DISFIELD},
+	{"sort_card", CoreMsg::SORT_CARD},
+	{"select_unselect_card", CoreMsg::SELECT_UNSELECT_CARD},
+	{"confirm_decktop", CoreMsg::CONFIRM_DECKTOP},
+	{"confirm_cards", CoreMsg::CONFIRM_CARDS},
+	{"shuffle_deck", CoreMsg::SHUFFLE_DECK},
+	{"shuffle_hand", CoreMsg::SHUFFLE_HAND},
+	{"refresh_deck", CoreMsg::REFRESH_DECK},
+	{"swap_grave_deck", CoreMsg::SWAP_GRAVE_DECK},
+	{"shuffle_set_card", CoreMsg::SHUFFLE_SET_CARD},
+	{"reverse_deck", CoreMsg::REVERSE_DECK},
+	{"deck_top", CoreMsg::DECK_TOP},
+	{"shuffle_extra", CoreMsg::SHUFFLE_EXTRA},
+	{"new_turn", CoreMsg::NEW_TURN},
+	{"new_phase", CoreMsg::NEW_PHASE},
+	{"confirm_extratop", CoreMsg::CONFIRM_EXTRATOP},
+	{"move", CoreMsg::MOVE},
+	{"pos_change", CoreMsg::POS_CHANGE},
+	{"set", CoreMsg::SET},
+	{"swap", CoreMsg::SWAP},
+	{"field_disabled", CoreMsg::FIELD_DISABLED},
+	{"summoning", CoreMsg::SUMMONING},
+	{"summoned", CoreMsg::SUMMONED},
+	{"spsummoning", CoreMsg::SPSUMMONING},
+	{"spsummoned", CoreMsg::SPSUMMONED},
+	{"flipsummoning", CoreMsg::FLIPSUMMONING},
+	{"flipsummoned", CoreMsg::FLIPSUMMONED},
+	{"chaining", CoreMsg::CHAINING},
+	{"chained", CoreMsg::CHAINED},
+	{"chain_solving", CoreMsg::CHAIN_SOLVING},
+	{"chain_solved", CoreMsg::CHAIN_SOLVED},
+	{"chain_end", CoreMsg::CHAIN_END},
+	{"chain_negated", CoreMsg::CHAIN_NEGATED},
+	{"chain_disabled", CoreMsg::CHAIN_DISABLED},
+	{"card_selected", CoreMsg::CARD_SELECTED},
+	{"random_selected", CoreMsg::RANDOM_SELECTED},
+	{"become_target", CoreMsg::BECOME_TARGET},
+	{"draw", CoreMsg::DRAW},
+	{"damage", CoreMsg::DAMAGE},
+	{"recover", CoreMsg::RECOVER},
+	{"equip", CoreMsg::EQUIP},
+	{"lpupdate", CoreMsg::LPUPDATE},
+	{"unequip", CoreMsg::UNEQUIP},
+	{"card_target", CoreMsg::CARD_TARGET},
+	{"cancel_target", CoreMsg::CANCEL_TARGET},
+	{"pay_lpcost", CoreMsg::PAY_LPCOST},
+	{"add_counter", CoreMsg::ADD_COUNTER},
+	{"remove_counter", CoreMsg::REMOVE_COUNTER},
+	{"attack", CoreMsg::ATTACK},
+	{"battle", CoreMsg::BATTLE},
+	{"attack_disabled", CoreMsg::ATTACK_DISABLED},
+	{"damage_step_start", CoreMsg::DAMAGE_STEP_START},
+	{"damage_step_end", CoreMsg::DAMAGE_STEP_END},
+	{"missed_effect", CoreMsg::MISSED_EFFECT},
+	{"be_chain_target", CoreMsg::BE_CHAIN_TARGET},
+	{"create_relation", CoreMsg::CREATE_RELATION},
+	{"release_relation", CoreMsg::RELEASE_RELATION},
+	{"toss_coin", CoreMsg::TOSS_COIN},
+	{"toss_dice", CoreMsg::TOSS_DICE},
+	{"rock_paper_scissors", CoreMsg::ROCK_PAPER_SCISSORS},
+	{"hand_res", CoreMsg::HAND_RES},
+	{"announce_race", CoreMsg::ANNOUNCE_RACE},
+	{"announce_attrib", CoreMsg::ANNOUNCE_ATTRIB},
+	{"announce_card", CoreMsg::ANNOUNCE_CARD},
+	{"announce_number", CoreMsg::ANNOUNCE_NUMBER},
+	{"card_hint", CoreMsg::CARD_HINT},
+	{"tag_swap", CoreMsg::TAG_SWAP},
+	{"reload_field", CoreMsg::RELOAD_FIELD},
+	{"ai_name", CoreMsg::AI_NAME},
+	{"show_hint", CoreMsg::SHOW_HINT},
+	{"player_hint", CoreMsg::PLAYER_HINT},
+	{"match_kill", CoreMsg::MATCH_KILL},
+	{"custom_msg", CoreMsg::CUSTOM_MSG},
+	{"remove_cards", CoreMsg::REMOVE_CARDS},
+}};
+
+constexpr auto core_msg_from_name(std::string_view name) noexcept
+	-> std::optional<CoreMsg>
+{
+	for(auto const& [n, msg] : CORE_MSG_NAMES)
+		if(n == name)
+			return msg;
+	return std::nullopt;
+}
+
+constexpr auto core_msg_name(CoreMsg msg) noexcept -> std::string_view
+{
+	for(auto const& [n, m] : CORE_MSG_NAMES)
+		if(m == msg)
+			return n;
+	return "unknown";
+}
+
+} // namespace YGOPro
+
+#endif // EDOPRO_DESKBOT_CORE_MSG_HPP
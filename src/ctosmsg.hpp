@@ -47,7 +47,7 @@ public:
 		// TIME_CONFIRM  = 0x15U,
 		CHAT = 0x16U,
 		TO_DUELIST = 0x20U,
-		// TO_OBSERVER   = 0x21U,
+		TO_OBSERVER = 0x21U,
 		READY = 0x22U,
 		// NOT_READY     = 0x23U,
 		// TRY_KICK      = 0x24U,
@@ -91,6 +91,11 @@ public:
 		ClientVersion version;
 	};
 
+	struct ToObserver
+	{
+		static constexpr auto ID = IdType::TO_OBSERVER;
+	};
+
 	struct Ready
 	{
 		static constexpr auto ID = IdType::READY;
@@ -189,6 +194,22 @@ private:
 	}
 };
 
+// First message of every connection, the name is the only thing sent.
+inline auto make_player_info() noexcept -> CTOSMsg
+{
+	auto player_info = CTOSMsg::PlayerInfo{};
+	player_info.name[0U] = L'虚';
+	return CTOSMsg::make_fixed(player_info);
+}
+
+inline auto make_join_game(uint32_t room_id) noexcept -> CTOSMsg
+{
+	auto join_game = CTOSMsg::JoinGame{};
+	join_game.id = room_id;
+	join_game.version = CLIENT_VERSION;
+	return CTOSMsg::make_fixed(join_game);
+}
+
 } // namespace YGOPro
 
 #endif // EDOPRO_DESKBOT_CTOSMSG_HPP
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "first_option.hpp"
+
+#include <algorithm>
+#include <cstring> // std::memcpy
+
+#include "core_msg.hpp"
+
+namespace
+{
+
+constexpr uint8_t LOCATION_MZONE = 0x04U;
+constexpr uint8_t LOCATION_SZONE = 0x08U;
+
+template<typename T>
+auto read(uint8_t const* buffer, size_t size, size_t offset, T& value) noexcept
+	-> bool
+{
+	if(offset + sizeof(T) > size)
+		return false;
+	std::memcpy(&value, buffer + offset, sizeof(T));
+	return true;
+}
+
+template<typename T>
+auto write(std::vector<uint8_t>& out, T value) noexcept -> void
+{
+	auto const old_size = out.size();
+	out.resize(old_size + sizeof(T));
+	std::memcpy(out.data() + old_size, &value, sizeof(T));
+}
+
+// Shared layout of SELECT_CARD and SELECT_TRIBUTE: player, cancelable, min,
+// max and card count. Selects the first `min` cards (at least one).
+auto select_first_cards(uint8_t const* buffer, size_t size,
+                        std::vector<uint8_t>& out) noexcept -> bool
+{
+	uint8_t cancelable{};
+	uint32_t min{};
+	uint32_t count{};
+	if(!read(buffer, size, 2U, cancelable) || !read(buffer, size, 3U, min) ||
+	   !read(buffer, size, 11U, count))
+		return false;
+	if(count == 0U)
+	{
+		if(cancelable == 0U)
+			return false;
+		write<int32_t>(out, -1);
+		return true;
+	}
+	auto const n = std::min(std::max(min, 1U), count);
+	write<int32_t>(out, 0); // Indexes are sent as uint32_t.
+	write<uint32_t>(out, n);
+	for(uint32_t i = 0U; i < n; i++)
+		write<uint32_t>(out, i);
+	return true;
+}
+
+// Picks the first free zones out of the (relative) disabled-zone flag of
+// SELECT_PLACE and SELECT_DISFIELD.
+auto select_first_places(uint8_t const* buffer, size_t size,
+                         std::vector<uint8_t>& out) noexcept -> bool
+{
+	// Zones of the requesting player come first; the unused bits between
+	// blocks are skipped.
+	constexpr uint32_t VALID_ZONES = 0xFF7FFF7FU;
+	uint8_t player{};
+	uint8_t count{};
+	uint32_t flag{};
+	if(!read(buffer, size, 1U, player) || !read(buffer, size, 2U, count) ||
+	   !read(buffer, size, 3U, flag))
+		return false;
+	uint32_t available = ~flag & VALID_ZONES;
+	for(uint8_t i = 0U; i < std::max<uint8_t>(count, 1U); i++)
+	{
+		if(available == 0U)
+			return false;
+		uint8_t bit = 0U;
+		while(((available >> bit) & 1U) == 0U)
+			bit++;
+		available &= ~(1U << bit);
+		bool const own = bit < 16U;
+		uint8_t const field_bit = bit % 16U;
+		write<uint8_t>(out, own ? player : static_cast<uint8_t>(1U - player));
+		write<uint8_t>(out, field_bit < 8U ? LOCATION_MZONE : LOCATION_SZONE);
+		write<uint8_t>(out, field_bit % 8U);
+	}
+	return true;
+}
+
+// Nodes the search for a valid SELECT_SUM combination may visit, so a huge
+// prompt can't stall the client.
+constexpr uint32_t SUM_SEARCH_BUDGET = 1U << 16U;
+
+struct SumCard
+{
+	uint32_t op1;
+	uint32_t op2; // Alternative value, or 0 if there's none.
+	bool must;    // Selected by the core, can't be left out.
+};
+
+// Depth-first search over the cards of a SELECT_SUM, trying to include every
+// card (with either of its values) before leaving it out, so the first
+// combination found is the one with the lowest indexes.
+class SumSearch
+{
+public:
+	SumSearch(std::vector<SumCard> const& cards, uint32_t acc, uint32_t min,
+	          uint32_t max, bool at_least) noexcept
+		: cards_(cards)
+		, acc_(acc)
+		, min_(min)
+		, max_(max)
+		, at_least_(at_least)
+		, budget_(SUM_SEARCH_BUDGET)
+		, chosen_()
+	{}
+
+	// Indexes of the chosen cards, must-select ones included.
+	auto run() noexcept -> std::vector<uint32_t> const*
+	{
+		chosen_.reserve(cards_.size());
+		return visit_(0U, 0U, UINT32_MAX) ? &chosen_ : nullptr;
+	}
+
+private:
+	std::vector<SumCard> const& cards_;
+	uint32_t const acc_;
+	uint32_t const min_;
+	uint32_t const max_;
+	bool const at_least_;
+	uint32_t budget_;
+	std::vector<uint32_t> chosen_;
+
+	// `lowest` is the smallest value chosen so far: at least mode requires
+	// every card to be needed to reach the sum.
+	auto visit_(size_t i, uint64_t sum, uint32_t lowest) noexcept -> bool
+	{
+		if(budget_ == 0U)
+			return false;
+		budget_--;
+		if(at_least_ ? (lowest != UINT32_MAX && sum - lowest >= acc_)
+		             : sum > acc_)
+			return false;
+		if(i == cards_.size())
+		{
+			auto const count = chosen_.size();
+			if(at_least_)
+				return sum >= acc_ && count != 0U;
+			return sum == acc_ && count >= min_ && count <= max_;
+		}
+		auto const include = [&](uint32_t value)
+		{
+			chosen_.push_back(static_cast<uint32_t>(i));
+			if(visit_(i + 1U, sum + value, std::min(lowest, value)))
+				return true;
+			chosen_.pop_back();
+			return false;
+		};
+		auto const& card = cards_[i];
+		if(include(card.op1) ||
+		   (card.op2 != 0U && card.op2 != card.op1 && include(card.op2)))
+			return true;
+		return !card.must && visit_(i + 1U, sum, lowest);
+	}
+};
+
+// SELECT_SUM: player, mode (0: exactly the sum, 1: at least the sum), the
+// sum, min and max amount of cards, then the must-select and the selectable
+// cards as a count followed by code, location info and sum parameter (two
+// values in its halves) each.
+auto select_first_sum(uint8_t const* buffer, size_t size,
+                      std::vector<uint8_t>& out) noexcept -> bool
+{
+	constexpr size_t CARD_SIZE = 18U;
+	constexpr size_t PARAM_OFFSET = 14U;
+	constexpr uint32_t PARAM_MASK = 0xFFFFU;
+	uint8_t mode{};
+	uint32_t acc{};
+	uint32_t min{};
+	uint32_t max{};
+	if(!read(buffer, size, 2U, mode) || !read(buffer, size, 3U, acc) ||
+	   !read(buffer, size, 7U, min) || !read(buffer, size, 11U, max))
+		return false;
+	std::vector<SumCard> cards;
+	size_t offset = 15U;
+	uint32_t must_count = 0U;
+	for(bool const must : {true, false})
+	{
+		uint32_t count{};
+		if(!read(buffer, size, offset, count))
+			return false;
+		offset += sizeof(count);
+		if(count > (size - offset) / CARD_SIZE)
+			return false;
+		for(uint32_t i = 0U; i < count; i++, offset += CARD_SIZE)
+		{
+			uint32_t param{};
+			read(buffer, size, offset + PARAM_OFFSET, param);
+			cards.push_back(SumCard{param & PARAM_MASK, param >> 16U, must});
+		}
+		if(must)
+			must_count = count;
+	}
+	SumSearch search(cards, acc, min, std::max(min, max), mode != 0U);
+	auto const* chosen = search.run();
+	if(chosen == nullptr)
+		return false;
+	// Only the selectable cards are answered, by their own index.
+	write<int32_t>(out, 0);
+	write<uint32_t>(out, static_cast<uint32_t>(chosen->size() - must_count));
+	for(auto const i : *chosen)
+	{
+		if(i >= must_count)
+			write<uint32_t>(out, i - must_count);
+	}
+	return true;
+}
+
+// SELECT_COUNTER: player, counter type, amount to remove and card count, then
+// each card with its current amount of counters last. Removes them from the
+// first cards on.
+auto select_first_counters(uint8_t const* buffer, size_t size,
+                           std::vector<uint8_t>& out) noexcept -> bool
+{
+	constexpr size_t CARDS_OFFSET = 10U;
+	uint16_t left{};
+	uint32_t count{};
+	if(!read(buffer, size, 4U, left) || !read(buffer, size, 6U, count) ||
+	   count == 0U || (size - CARDS_OFFSET) % count != 0U)
+		return false;
+	auto const card_size = (size - CARDS_OFFSET) / count;
+	if(card_size < sizeof(uint16_t))
+		return false;
+	for(uint32_t i = 0U; i < count; i++)
+	{
+		uint16_t counters{};
+		read(buffer, size,
+		     CARDS_OFFSET + (i + 1U) * card_size - sizeof(counters), counters);
+		auto const n = std::min(counters, left);
+		write<uint16_t>(out, n);
+		left = static_cast<uint16_t>(left - n);
+	}
+	return left == 0U;
+}
+
+// ANNOUNCE_RACE and ANNOUNCE_ATTRIB: player, amount to announce and the
+// available ones as flags, which may be 32 or 64 bits wide. Answers with the
+// lowest flags, as wide as they came.
+auto announce_first_flags(uint8_t const* buffer, size_t size,
+                          std::vector<uint8_t>& out) noexcept -> bool
+{
+	constexpr size_t FLAGS_OFFSET = 3U;
+	uint8_t count{};
+	uint64_t available{};
+	if(!read(buffer, size, 2U, count))
+		return false;
+	if(size == FLAGS_OFFSET + sizeof(uint32_t))
+	{
+		uint32_t flags{};
+		read(buffer, size, FLAGS_OFFSET, flags);
+		available = flags;
+	}
+	else if(!read(buffer, size, FLAGS_OFFSET, available))
+	{
+		return false;
+	}
+	uint64_t chosen = 0U;
+	for(uint8_t i = 0U; i < count; i++)
+	{
+		if(available == 0U)
+			return false;
+		auto const lowest = available & (~available + 1U);
+		chosen |= lowest;
+		available &= ~lowest;
+	}
+	if(size == FLAGS_OFFSET + sizeof(uint32_t))
+		write<uint32_t>(out, static_cast<uint32_t>(chosen));
+	else
+		write<uint64_t>(out, chosen);
+	return true;
+}
+
+// ANNOUNCE_CARD: player and the amount of opcodes (32 or 64 bits each) of the
+// filter the card must pass. The filter needs card data to be evaluated, so
+// this takes the card it names (`code ISCODE`) or else the first one of the
+// deck.
+auto announce_first_card(uint8_t const* buffer, size_t size,
+                         uint32_t const* deck_ptr, size_t deck_size,
+                         std::vector<uint8_t>& out) noexcept -> bool
+{
+	constexpr size_t OPCODES_OFFSET = 3U;
+	constexpr uint64_t FIRST_OPERATOR = 0x40000000U; // Others are values.
+	constexpr uint64_t OPCODE_NOT = 0x40000007U;
+	constexpr uint64_t OPCODE_ISCODE = 0x40000100U;
+	uint8_t count{};
+	if(!read(buffer, size, 2U, count) || count == 0U ||
+	   (size - OPCODES_OFFSET) % count != 0U)
+		return false;
+	auto const width = (size - OPCODES_OFFSET) / count;
+	if(width != sizeof(uint32_t) && width != sizeof(uint64_t))
+		return false;
+	auto const opcode = [&](size_t i) -> uint64_t
+	{
+		uint64_t value = 0U;
+		std::memcpy(&value, buffer + OPCODES_OFFSET + i * width, width);
+		return value;
+	};
+	for(size_t i = 1U; i < count; i++)
+	{
+		if(opcode(i) != OPCODE_ISCODE || opcode(i - 1U) >= FIRST_OPERATOR ||
+		   (i + 1U < count && opcode(i + 1U) == OPCODE_NOT))
+			continue;
+		write<int32_t>(out, static_cast<int32_t>(opcode(i - 1U)));
+		return true;
+	}
+	if(deck_size == 0U)
+		return false;
+	write<int32_t>(out, static_cast<int32_t>(deck_ptr[0U]));
+	return true;
+}
+
+} // namespace
+
+auto first_option_answer(uint8_t const* buffer, size_t size,
+                         uint32_t const* deck_ptr, size_t deck_size,
+                         std::vector<uint8_t>& out) noexcept -> bool
+{
+	using YGOPro::CoreMsg;
+	out.clear();
+	if(size == 0U)
+		return false;
+	switch(static_cast<CoreMsg>(*buffer))
+	{
+	case CoreMsg::SELECT_BATTLECMD:
+	{
+		// Message ends with the "to main phase 2" and "to end phase" flags.
+		if(size < 3U)
+			return false;
+		if(buffer[size - 1U] != 0U)
+			write<int32_t>(out, 3);
+		else if(buffer[size - 2U] != 0U)
+			write<int32_t>(out, 2);
+		else
+			return false;
+		return true;
+	}
+	case CoreMsg::SELECT_IDLECMD:
+	{
+		// Message ends with the "to battle phase", "to end phase" and "can
+		// shuffle" flags.
+		if(size < 4U)
+			return false;
+		if(buffer[size - 2U] != 0U)
+			write<int32_t>(out, 7);
+		else if(buffer[size - 3U] != 0U)
+			write<int32_t>(out, 6);
+		else
+			return false;
+		return true;
+	}
+	case CoreMsg::SELECT_EFFECTYN:
+	case CoreMsg::SELECT_YESNO:
+	case CoreMsg::SELECT_OPTION:
+	case CoreMsg::ANNOUNCE_NUMBER:
+	{
+		write<int32_t>(out, 0);
+		return true;
+	}
+	case CoreMsg::SELECT_CARD:
+	case CoreMsg::SELECT_TRIBUTE:
+	{
+		return select_first_cards(buffer, size, out);
+	}
+	case CoreMsg::SELECT_CHAIN:
+	{
+		uint8_t forced{};
+		if(!read(buffer, size, 3U, forced))
+			return false;
+		write<int32_t>(out, forced != 0U ? 0 : -1);
+		return true;
+	}
+	case CoreMsg::SELECT_POSITION:
+	{
+		uint8_t positions{};
+		if(!read(buffer, size, 6U, positions) || positions == 0U)
+			return false;
+		write<int32_t>(out, positions & -positions);
+		return true;
+	}
+	case CoreMsg::SELECT_PLACE:
+	case CoreMsg::SELECT_DISFIELD:
+	{
+		return select_first_places(buffer, size, out);
+	}
+	case CoreMsg::SELECT_COUNTER:
+	{
+		return select_first_counters(buffer, size, out);
+	}
+	case CoreMsg::SELECT_SUM:
+	{
+		return select_first_sum(buffer, size, out);
+	}
+	case CoreMsg::SORT_CHAIN:
+	case CoreMsg::SORT_CARD:
+	{
+		write<int32_t>(out, -1); // Keep the default order.
+		return true;
+	}
+	case CoreMsg::SELECT_UNSELECT_CARD:
+	{
+		uint8_t finishable{};
+		uint8_t cancelable{};
+		if(!read(buffer, size, 2U, finishable) ||
+		   !read(buffer, size, 3U, cancelable) ||
+		   (finishable == 0U && cancelable == 0U))
+			return false;
+		write<int32_t>(out, -1);
+		return true;
+	}
+	case CoreMsg::ROCK_PAPER_SCISSORS:
+	{
+		write<int32_t>(out, 1);
+		return true;
+	}
+	case CoreMsg::ANNOUNCE_RACE:
+	case CoreMsg::ANNOUNCE_ATTRIB:
+	{
+		return announce_first_flags(buffer, size, out);
+	}
+	case CoreMsg::ANNOUNCE_CARD:
+	{
+		return announce_first_card(buffer, size, deck_ptr, deck_size, out);
+	}
+	default:
+		return false;
+	}
+}
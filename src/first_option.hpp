@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_FIRST_OPTION_HPP
+#define EDOPRO_DESKBOT_FIRST_OPTION_HPP
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <vector>
+
+// Trivial built-in policy that answers a raw core request (a GAME_MSG body)
+// without going through the Core: it passes whenever passing is allowed and
+// otherwise picks the first valid option. Card announcements can't be checked
+// without card data, so they name the card the request itself mentions or the
+// first one of the deck. Writes the response bytes into `out` and returns
+// true, or returns false if the request is not one that this policy knows how
+// to answer (or has no valid option).
+auto first_option_answer(uint8_t const* buffer, size_t size,
+                         uint32_t const* deck_ptr, size_t deck_size,
+                         std::vector<uint8_t>& out) noexcept -> bool;
+
+#endif // EDOPRO_DESKBOT_FIRST_OPTION_HPP
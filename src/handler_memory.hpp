@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_HANDLER_MEMORY_HPP
+#define EDOPRO_DESKBOT_HANDLER_MEMORY_HPP
+#include <array>
+#include <cstddef> // size_t, std::max_align_t
+#include <new>
+
+// Storage for the handler of one outstanding asynchronous operation, so a
+// loop issuing one operation after the other reuses the same block instead
+// of going to the heap every time. Falls back to the heap if the block is
+// taken or too small.
+class HandlerMemory
+{
+public:
+	static constexpr size_t SIZE = 1U << 10U;
+
+	constexpr HandlerMemory() noexcept : storage_(), in_use_(false) {}
+
+	HandlerMemory(const HandlerMemory&) = delete;
+	HandlerMemory(HandlerMemory&&) noexcept = delete;
+	auto operator=(const HandlerMemory&) -> HandlerMemory& = delete;
+	auto operator=(HandlerMemory&&) noexcept -> HandlerMemory& = delete;
+
+	auto allocate(size_t size) -> void*
+	{
+		if(!in_use_ && size <= storage_.size())
+		{
+			in_use_ = true;
+			return storage_.data();
+		}
+		return ::operator new(size);
+	}
+
+	auto deallocate(void* ptr) noexcept -> void
+	{
+		if(ptr == storage_.data())
+		{
+			in_use_ = false;
+			return;
+		}
+		::operator delete(ptr);
+	}
+
+private:
+	alignas(std::max_align_t) std::array<std::byte, SIZE> storage_;
+	bool in_use_;
+};
+
+// Minimal allocator over HandlerMemory, to be bound to completion tokens with
+// boost::asio::bind_allocator.
+template<typename T>
+class HandlerAllocator
+{
+public:
+	using value_type = T;
+
+	explicit HandlerAllocator(HandlerMemory& memory) noexcept : memory_(&memory)
+	{}
+
+	template<typename U>
+	HandlerAllocator(HandlerAllocator<U> const& other) noexcept // NOLINT
+		: memory_(other.memory_)
+	{}
+
+	auto allocate(size_t n) -> T*
+	{
+		return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+	}
+
+	auto deallocate(T* ptr, size_t /*unused*/) noexcept -> void
+	{
+		memory_->deallocate(ptr);
+	}
+
+	template<typename U>
+	auto operator==(HandlerAllocator<U> const& other) const noexcept -> bool
+	{
+		return memory_ == other.memory_;
+	}
+
+	template<typename U>
+	auto operator!=(HandlerAllocator<U> const& other) const noexcept -> bool
+	{
+		return memory_ != other.memory_;
+	}
+
+private:
+	template<typename>
+	friend class HandlerAllocator;
+
+	HandlerMemory* memory_;
+};
+
+#endif // EDOPRO_DESKBOT_HANDLER_MEMORY_HPP
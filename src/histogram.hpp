@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_HISTOGRAM_HPP
+#define EDOPRO_DESKBOT_HISTOGRAM_HPP
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+
+// Fixed-size log-linear histogram of durations with microsecond resolution.
+// Every power of two is split in 8 sub-buckets, so percentiles are reported
+// with at most 12.5% of error. Cheap enough to keep one per thread and merge
+// them when reporting.
+class LatencyHistogram
+{
+public:
+	constexpr LatencyHistogram() noexcept : buckets_(), count_(0U), max_(0U) {}
+
+	template<typename Rep, typename Period>
+	auto record(std::chrono::duration<Rep, Period> d) noexcept -> void
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+		auto const us = static_cast<uint64_t>(
+			std::max<Rep>(duration_cast<microseconds>(d).count(), Rep{0}));
+		buckets_[index_(us)]++;
+		count_++;
+		max_ = std::max(max_, us);
+	}
+
+	auto merge(LatencyHistogram const& other) noexcept -> void
+	{
+		for(size_t i = 0U; i < BUCKETS; i++)
+			buckets_[i] += other.buckets_[i];
+		count_ += other.count_;
+		max_ = std::max(max_, other.max_);
+	}
+
+	[[nodiscard]] auto count() const noexcept -> uint64_t { return count_; }
+
+	[[nodiscard]] auto max() const noexcept -> std::chrono::microseconds
+	{
+		return std::chrono::microseconds(max_);
+	}
+
+	// Upper bound of the bucket holding the given percentile (0-100).
+	[[nodiscard]] auto percentile(double p) const noexcept
+		-> std::chrono::microseconds
+	{
+		auto const target = static_cast<uint64_t>(
+			static_cast<double>(count_) * std::min(p, 100.0) / 100.0);
+		uint64_t seen = 0U;
+		for(size_t i = 0U; i < BUCKETS; i++)
+		{
+			seen += buckets_[i];
+			if(seen > target || (seen == count_ && seen != 0U))
+				return std::chrono::microseconds(
+					std::min(upper_bound_(i), max_));
+		}
+		return std::chrono::microseconds(0);
+	}
+
+private:
+	static constexpr unsigned SUB_BUCKET_BITS = 3U;
+	static constexpr uint64_t SUB_BUCKETS = 1U << SUB_BUCKET_BITS;
+	static constexpr size_t BUCKETS =
+		(64U - SUB_BUCKET_BITS + 1U) * SUB_BUCKETS;
+
+	std::array<uint64_t, BUCKETS> buckets_;
+	uint64_t count_;
+	uint64_t max_;
+
+	static constexpr auto index_(uint64_t v) noexcept -> size_t
+	{
+		if(v < SUB_BUCKETS)
+			return static_cast<size_t>(v);
+		unsigned e = 0U;
+		while((v >> (e + 1U)) != 0U)
+			e++;
+		auto const m = (v >> (e - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1U);
+		return static_cast<size_t>((e - SUB_BUCKET_BITS + 1U) * SUB_BUCKETS +
+		                           m);
+	}
+
+	static constexpr auto upper_bound_(size_t i) noexcept -> uint64_t
+	{
+		if(i < SUB_BUCKETS)
+			return i;
+		auto const e = static_cast<unsigned>(i / SUB_BUCKETS) +
+		               SUB_BUCKET_BITS - 1U;
+		auto const m = i % SUB_BUCKETS;
+		auto const shift = e - SUB_BUCKET_BITS;
+		return ((SUB_BUCKETS + m) << shift) + ((uint64_t{1U} << shift) - 1U);
+	}
+};
+
+// For printing percentiles.
+constexpr auto to_ms(std::chrono::microseconds us) noexcept -> double
+{
+	return static_cast<double>(us.count()) / 1000.0;
+}
+
+#endif // EDOPRO_DESKBOT_HISTOGRAM_HPP
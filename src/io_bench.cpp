@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "io_bench.hpp"
+
+#include <array>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring> // std::memcpy
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "alloc_tracking.hpp"
+#include "client.hpp"
+#include "common_msg.hpp"
+#include "ctosmsg.hpp"
+#include "histogram.hpp"
+#include "stocmsg.hpp"
+
+namespace
+{
+
+using boost::asio::ip::tcp;
+using YGOPro::CTOSMsg;
+using YGOPro::STOCMsg;
+
+auto send_frame(tcp::socket& socket, STOCMsg::IdType type, void const* body,
+                size_t size) -> void
+{
+	std::array<uint8_t, STOCMsg::MAX_LENGTH> frame{};
+	auto const frame_size = static_cast<STOCMsg::SizeType>(size + 1U);
+	std::memcpy(frame.data(), &frame_size, sizeof(frame_size));
+	frame[sizeof(frame_size)] = static_cast<uint8_t>(type);
+	std::memcpy(frame.data() + STOCMsg::HEADER_SIZE, body, size);
+	auto const frame_bytes = STOCMsg::HEADER_SIZE + size;
+	boost::asio::write(socket, boost::asio::buffer(frame.data(), frame_bytes));
+}
+
+template<typename T>
+auto send_fixed(tcp::socket& socket, T const& body) -> void
+{
+	send_frame(socket, T::ID, &body, sizeof(T));
+}
+
+auto send_empty(tcp::socket& socket, STOCMsg::IdType type) -> void
+{
+	send_frame(socket, type, nullptr, 0U);
+}
+
+// Reads what the client sends until a message of the given type.
+auto wait_for(tcp::socket& socket, CTOSMsg::IdType type) -> void
+{
+	std::array<uint8_t, CTOSMsg::MAX_LENGTH> body{};
+	for(;;)
+	{
+		uint16_t size = 0U;
+		boost::asio::read(socket, boost::asio::buffer(&size, sizeof(size)));
+		if(size == 0U || size > body.size())
+			throw std::runtime_error("client sent an invalid message size");
+		boost::asio::read(socket, boost::asio::buffer(body.data(), size));
+		if(body[0U] == type)
+			return;
+	}
+}
+
+} // namespace
+
+IoBenchmark::IoBenchmark(Options const& options) : options_(options) {}
+
+auto IoBenchmark::run() -> void
+{
+	using Clock = std::chrono::steady_clock;
+	boost::asio::io_context client_io;
+	boost::asio::io_context server_io;
+	tcp::acceptor acceptor(
+		server_io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0U));
+	tcp::socket socket(client_io);
+	socket.connect(acceptor.local_endpoint());
+	socket.set_option(tcp::no_delay(true));
+	tcp::socket server(server_io);
+	acceptor.accept(server);
+	server.set_option(tcp::no_delay(true));
+	Client client(std::move(socket),
+	              Client::Options{options_.deck_ptr, options_.deck_size,
+	                              options_.script, nullptr, nullptr, 0U,
+	                              nullptr, nullptr, nullptr, nullptr});
+	std::thread client_thread([&client_io]() { client_io.run(); });
+	// Runs `f` in the client thread, between two of its messages.
+	auto const on_client_thread = [&client_io](auto f)
+	{
+		std::promise<void> done;
+		boost::asio::post(client_io,
+		                  [&]()
+		                  {
+							  f();
+							  done.set_value();
+						  });
+		done.get_future().wait();
+	};
+	LatencyHistogram round_trips;
+	Clock::duration flood_time{};
+	// NOTE: Counting from the client thread only, which runs nothing else.
+	std::optional<AllocTracking::Counter> allocs;
+	uint64_t round_trip_allocs = 0U;
+	uint64_t flood_allocs = 0U;
+	try
+	{
+		wait_for(server, CTOSMsg::IdType::CREATE_GAME);
+		{
+			auto join_game = STOCMsg::JoinGame{YGOPro::default_host_info()};
+			join_game.host_info.t0_count = 1U;
+			join_game.host_info.t1_count = 1U;
+			send_fixed(server, join_game);
+		}
+		send_fixed(server, STOCMsg::TypeChange{0U});
+		wait_for(server, CTOSMsg::IdType::READY);
+		send_empty(server, STOCMsg::IdType::DUEL_START);
+		auto const total = options_.warmup + options_.frames;
+		for(uint32_t i = 0U; i < total; i++)
+		{
+			if(i == options_.warmup)
+				on_client_thread([&]() { allocs.emplace(); });
+			auto const start = Clock::now();
+			send_empty(server, STOCMsg::IdType::CHOOSE_RPS);
+			wait_for(server, CTOSMsg::IdType::RPS_CHOICE);
+			if(i >= options_.warmup)
+				round_trips.record(Clock::now() - start);
+		}
+		on_client_thread(
+			[&]()
+			{
+				round_trip_allocs = allocs->count();
+				allocs.emplace();
+			});
+		// Messages the client reads and drops, fenced by one it answers.
+		auto const start = Clock::now();
+		for(uint32_t i = 0U; i < options_.frames; i++)
+			send_fixed(server, STOCMsg::PlayerChange{0U});
+		send_empty(server, STOCMsg::IdType::CHOOSE_RPS);
+		wait_for(server, CTOSMsg::IdType::RPS_CHOICE);
+		flood_time = Clock::now() - start;
+		on_client_thread([&]() { flood_allocs = allocs->count(); });
+		send_empty(server, STOCMsg::IdType::DUEL_END);
+	}
+	catch(...)
+	{
+		// Makes the client stop, so its thread can be joined. Closing our end
+		// instead would just make it reconnect to the acceptor.
+		boost::asio::post(client_io, [&client]() { client.close(); });
+		client_thread.join();
+		throw;
+	}
+	client_thread.join();
+	std::printf(
+		"Round trips (ms): p50 %.3f, p90 %.3f, p99 %.3f, max %.3f (%llu "
+		"samples).\n",
+		to_ms(round_trips.percentile(50.0)),
+		to_ms(round_trips.percentile(90.0)),
+		to_ms(round_trips.percentile(99.0)), to_ms(round_trips.max()),
+		static_cast<unsigned long long>(round_trips.count()));
+	auto const flood_s = std::chrono::duration<double>(flood_time).count();
+	std::printf("Flood: %u messages read in %.1fms (%.0f per second).\n",
+	            options_.frames, flood_s * 1000.0,
+	            flood_s > 0.0 ? options_.frames / flood_s : 0.0);
+	if constexpr(AllocTracking::ENABLED)
+	{
+		std::printf("Client thread allocations after warm-up: %llu over %u "
+		            "round trips, %llu over %u flooded messages.\n",
+		            static_cast<unsigned long long>(round_trip_allocs),
+		            options_.frames,
+		            static_cast<unsigned long long>(flood_allocs),
+		            options_.frames);
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_IO_BENCH_HPP
+#define EDOPRO_DESKBOT_IO_BENCH_HPP
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <string_view>
+
+// Measures the Client's message I/O in isolation over loopback: an
+// in-process fake server takes a Client through the lobby into a duel, then
+// times round trips of a prompt the Client answers without the Core
+// (CHOOSE_RPS), and floods it with messages it only reads. In builds with
+// allocation tracking, the allocations the client thread makes after the
+// warm-up are reported as well.
+class IoBenchmark
+{
+public:
+	struct Options
+	{
+		uint32_t const* deck_ptr;
+		size_t deck_size;
+		std::string_view script;
+		uint32_t frames; // Per measurement, after the warm-up.
+		uint32_t warmup;
+	};
+
+	explicit IoBenchmark(Options const& options);
+
+	// Runs both measurements and prints the report to stdout. Throws if the
+	// loopback connection fails or the client stops early.
+	auto run() -> void;
+
+private:
+	Options options_;
+};
+
+#endif // EDOPRO_DESKBOT_IO_BENCH_HPP
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_KEY_VALUE_ARGS_HPP
+#define EDOPRO_DESKBOT_KEY_VALUE_ARGS_HPP
+#include <cstdint> // uint64_t
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Whole string as an unsigned number, throws std::invalid_argument otherwise.
+inline auto parse_uint(std::string_view str) -> uint64_t
+{
+	auto const copy = std::string(str);
+	size_t pos = 0U;
+	auto const r = std::stoull(copy, &pos);
+	if(pos != copy.size())
+		throw std::invalid_argument(copy);
+	return r;
+}
+
+// Splits command line arguments of the form `key=value` from positional ones.
+// Getters throw std::invalid_argument when a value can't be parsed.
+class KeyValueArgs
+{
+public:
+	KeyValueArgs(int argc, char const* const* argv)
+	{
+		for(int i = 0; i < argc; i++)
+		{
+			auto const arg = std::string_view(argv[i]);
+			if(auto const eq = arg.find('='); eq != std::string_view::npos)
+				values_.emplace(arg.substr(0U, eq), arg.substr(eq + 1U));
+			else
+				positional_.emplace_back(arg);
+		}
+	}
+
+	[[nodiscard]] auto positional() const noexcept
+		-> std::vector<std::string_view> const&
+	{
+		return positional_;
+	}
+
+	[[nodiscard]] auto get(std::string_view key,
+	                       std::string_view fallback) const -> std::string_view
+	{
+		auto const it = values_.find(key);
+		return it != values_.end() ? it->second : fallback;
+	}
+
+	[[nodiscard]] auto get_uint(std::string_view key, uint64_t fallback) const
+		-> uint64_t
+	{
+		auto const it = values_.find(key);
+		if(it == values_.end())
+			return fallback;
+		return parse_uint(it->second);
+	}
+
+	[[nodiscard]] auto get_double(std::string_view key, double fallback) const
+		-> double
+	{
+		auto const it = values_.find(key);
+		if(it == values_.end())
+			return fallback;
+		auto const str = std::string(it->second);
+		size_t pos = 0U;
+		auto const r = std::stod(str, &pos);
+		if(pos != str.size())
+			throw std::invalid_argument(str);
+		return r;
+	}
+
+private:
+	std::map<std::string_view, std::string_view, std::less<>> values_;
+	std::vector<std::string_view> positional_;
+};
+
+#endif // EDOPRO_DESKBOT_KEY_VALUE_ARGS_HPP
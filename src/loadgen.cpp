@@ -0,0 +1,703 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "loadgen.hpp"
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring> // std::memcpy
+#include <list>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "core_msg.hpp"
+#include "ctosmsg.hpp"
+#include "first_option.hpp"
+#include "histogram.hpp"
+#include "key_value_args.hpp"
+#include "stocmsg.hpp"
+
+namespace
+{
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+// Body buffers that grew past this are released after the message that made
+// them grow is handled, so only clients handling big messages hold them.
+constexpr size_t BODY_RETAIN_CAPACITY = 1U << 9U;
+
+struct Stats
+{
+	LatencyHistogram join_time;
+	LatencyHistogram response_latency;
+	uint64_t rooms{};
+	uint64_t clients{};
+	uint64_t connect_errors{};
+	uint64_t io_errors{};
+	uint64_t server_errors{};
+	uint64_t unsupported_requests{};
+	uint64_t responses{};
+	uint64_t duels_started{};
+	uint64_t duels_ended{};
+
+	auto merge(Stats const& other) noexcept -> void
+	{
+		join_time.merge(other.join_time);
+		response_latency.merge(other.response_latency);
+		rooms += other.rooms;
+		clients += other.clients;
+		connect_errors += other.connect_errors;
+		io_errors += other.io_errors;
+		server_errors += other.server_errors;
+		unsupported_requests += other.unsupported_requests;
+		responses += other.responses;
+		duels_started += other.duels_started;
+		duels_ended += other.duels_ended;
+	}
+};
+
+struct Room
+{
+	LoadGenerator::RoomKind kind;
+	uint32_t id;
+	uint32_t clients; // Not destroyed yet.
+};
+
+auto kind_weights(std::vector<LoadGenerator::RoomKind> const& mix) noexcept
+	-> std::discrete_distribution<size_t>
+{
+	std::vector<double> weights;
+	weights.reserve(mix.size());
+	for(auto const& kind : mix)
+		weights.push_back(static_cast<double>(kind.weight));
+	return {weights.begin(), weights.end()};
+}
+
+class Shard;
+
+class LoadClient
+{
+public:
+	LoadClient(Shard& shard, Room& room, bool hosting) noexcept;
+
+	LoadClient(const LoadClient&) = delete;
+	LoadClient(LoadClient&&) noexcept = delete;
+	auto operator=(const LoadClient&) -> LoadClient& = delete;
+	auto operator=(LoadClient&&) noexcept -> LoadClient& = delete;
+
+	auto start() noexcept -> void;
+	auto close() noexcept -> void;
+
+	// Closed and no handler left to run, so it can be destroyed.
+	[[nodiscard]] auto done() const noexcept -> bool
+	{
+		return closed_ && pending_ops_ == 0U;
+	}
+
+	[[nodiscard]] auto room() noexcept -> Room& { return room_; }
+
+private:
+	Shard& shard_;
+	Room& room_;
+	tcp::socket socket_;
+	std::array<uint8_t, YGOPro::STOCMsg::HEADER_SIZE> header_;
+	std::vector<uint8_t> body_;
+	std::vector<uint8_t> pending_;
+	std::vector<uint8_t> in_flight_;
+	Clock::time_point started_;
+	Clock::time_point responded_;
+	uint8_t ready_mask_;
+	uint8_t pending_ops_; // Asynchronous operations not completed yet.
+	bool hosting_;
+	bool awaiting_reply_;
+	bool writing_;
+	bool closed_;
+
+	auto send_msg_(YGOPro::CTOSMsg const& msg) noexcept -> void;
+	auto do_write_() noexcept -> void;
+
+	auto do_read_header_() noexcept -> void;
+	auto do_read_body_() noexcept -> void;
+
+	auto handle_msg_() noexcept -> bool;
+	auto handle_game_msg_() noexcept -> bool;
+
+	[[nodiscard]] auto type_() const noexcept -> YGOPro::STOCMsg::IdType;
+
+	template<typename T>
+	[[nodiscard]] auto as_fixed_() const noexcept -> T
+	{
+		static_assert(std::is_standard_layout_v<T>);
+		assert(T::ID == type_());
+		T r{};
+		std::memcpy(&r, body_.data(), std::min(sizeof(T), body_.size()));
+		return r;
+	}
+};
+
+class Shard
+{
+public:
+	Shard(LoadGenerator::Options const& options,
+	      tcp::resolver::results_type endpoints, uint32_t rooms,
+	      Clock::duration interval, unsigned seed);
+
+	auto run() -> void;
+
+	auto io_context() noexcept -> boost::asio::io_context& { return io_; }
+	auto options() const noexcept -> LoadGenerator::Options const&
+	{
+		return options_;
+	}
+	auto endpoints() const noexcept -> tcp::resolver::results_type const&
+	{
+		return endpoints_;
+	}
+	auto stats() noexcept -> Stats& { return stats_; }
+
+	// Scratch space for answers, which are copied into a CTOSMsg right away.
+	auto answer_buffer() noexcept -> std::vector<uint8_t>& { return answer_; }
+
+	auto on_room_created(Room& room) noexcept -> void;
+	auto on_client_closed() noexcept -> void;
+
+private:
+	// NOTE: Must outlive the clients, as their sockets use it.
+	boost::asio::io_context io_;
+	LoadGenerator::Options const& options_;
+	tcp::resolver::results_type endpoints_;
+	boost::asio::steady_timer arrival_timer_;
+	boost::asio::steady_timer deadline_timer_;
+	Clock::time_point next_arrival_;
+	Clock::duration interval_;
+	uint32_t rooms_left_;
+	size_t live_clients_;
+	bool stopping_;
+	std::mt19937 rng_;
+	std::discrete_distribution<size_t> pick_kind_;
+	Stats stats_;
+	std::vector<uint8_t> answer_;
+	// Lists, so finished rooms and clients can be destroyed wherever they are.
+	std::list<Room> rooms_;
+	std::list<LoadClient> clients_;
+
+	auto schedule_arrival_() noexcept -> void;
+	auto spawn_(Room& room, bool hosting) noexcept -> void;
+	auto maybe_finish_() noexcept -> void;
+	// Destroys the clients that are done, and the rooms left without any.
+	// NOTE: Not to be called from a client's handler.
+	auto collect_() noexcept -> void;
+};
+
+// LoadClient
+
+LoadClient::LoadClient(Shard& shard, Room& room, bool hosting) noexcept
+	: shard_(shard)
+	, room_(room)
+	, socket_(shard.io_context())
+	, header_()
+	, ready_mask_(0U)
+	, pending_ops_(0U)
+	, hosting_(hosting)
+	, awaiting_reply_(false)
+	, writing_(false)
+	, closed_(false)
+{}
+
+auto LoadClient::start() noexcept -> void
+{
+	started_ = Clock::now();
+	pending_ops_++;
+	boost::asio::async_connect(
+		socket_, shard_.endpoints(),
+		[this](boost::system::error_code ec, tcp::endpoint const& /*unused*/)
+		{
+			pending_ops_--;
+			if(closed_)
+				return;
+			if(ec)
+			{
+				shard_.stats().connect_errors++;
+				close();
+				return;
+			}
+			using namespace YGOPro;
+			send_msg_(make_player_info());
+			if(hosting_)
+			{
+				auto create_game = CTOSMsg::CreateGame{};
+				create_game.host_info = default_host_info();
+				create_game.host_info.t0_count = room_.kind.t0_count;
+				create_game.host_info.t1_count = room_.kind.t1_count;
+				send_msg_(CTOSMsg::make_fixed(create_game));
+			}
+			else
+			{
+				send_msg_(make_join_game(room_.id));
+			}
+			do_read_header_();
+		});
+}
+
+auto LoadClient::close() noexcept -> void
+{
+	if(closed_)
+		return;
+	closed_ = true;
+	boost::system::error_code ec;
+	socket_.close(ec);
+	body_ = {};
+	pending_ = {};
+	in_flight_ = {};
+	shard_.on_client_closed();
+}
+
+auto LoadClient::send_msg_(YGOPro::CTOSMsg const& msg) noexcept -> void
+{
+	pending_.insert(pending_.end(), msg.data(), msg.data() + msg.size());
+	if(!writing_)
+		do_write_();
+}
+
+auto LoadClient::do_write_() noexcept -> void
+{
+	// Everything queued while the previous write was in flight goes out in a
+	// single write.
+	std::swap(pending_, in_flight_);
+	pending_.clear();
+	writing_ = true;
+	pending_ops_++;
+	boost::asio::async_write(
+		socket_, boost::asio::buffer(in_flight_),
+		[this](boost::system::error_code ec, size_t /*unused*/)
+		{
+			pending_ops_--;
+			if(closed_)
+				return;
+			if(ec)
+			{
+				shard_.stats().io_errors++;
+				close();
+				return;
+			}
+			writing_ = false;
+			if(!pending_.empty())
+				do_write_();
+		});
+}
+
+auto LoadClient::do_read_header_() noexcept -> void
+{
+	pending_ops_++;
+	boost::asio::async_read(
+		socket_, boost::asio::buffer(header_),
+		[this](boost::system::error_code ec, size_t /*unused*/)
+		{
+			pending_ops_--;
+			if(closed_)
+				return;
+			if(ec)
+			{
+				shard_.stats().io_errors++;
+				close();
+				return;
+			}
+			do_read_body_();
+		});
+}
+
+auto LoadClient::do_read_body_() noexcept -> void
+{
+	YGOPro::STOCMsg::SizeType size{};
+	std::memcpy(&size, header_.data(), sizeof(size));
+	if(size == 0U)
+	{
+		shard_.stats().io_errors++;
+		close();
+		return;
+	}
+	body_.resize(size - 1U);
+	pending_ops_++;
+	boost::asio::async_read(
+		socket_, boost::asio::buffer(body_),
+		[this](boost::system::error_code ec, size_t /*unused*/)
+		{
+			pending_ops_--;
+			if(closed_)
+				return;
+			if(ec)
+			{
+				shard_.stats().io_errors++;
+				close();
+				return;
+			}
+			bool const keep_reading = handle_msg_();
+			if(body_.capacity() > BODY_RETAIN_CAPACITY)
+				body_ = {};
+			if(keep_reading)
+				do_read_header_();
+			else
+				close();
+		});
+}
+
+auto LoadClient::type_() const noexcept -> YGOPro::STOCMsg::IdType
+{
+	return static_cast<YGOPro::STOCMsg::IdType>(
+		header_[sizeof(YGOPro::STOCMsg::SizeType)]);
+}
+
+auto LoadClient::handle_msg_() noexcept -> bool
+{
+	using namespace YGOPro;
+	auto& stats = shard_.stats();
+	switch(type_())
+	{
+	case STOCMsg::IdType::GAME_MSG:
+	{
+		return handle_game_msg_();
+	}
+	case STOCMsg::IdType::ERROR_MSG:
+	{
+		stats.server_errors++;
+		return false;
+	}
+	case STOCMsg::IdType::CHOOSE_RPS:
+	{
+		send_msg_(CTOSMsg::make_fixed(CTOSMsg::RPSChoice{1U}));
+		return true;
+	}
+	case STOCMsg::IdType::CHOOSE_ORDER:
+	{
+		send_msg_(CTOSMsg::make_fixed(CTOSMsg::TurnChoice{0U}));
+		return true;
+	}
+	case STOCMsg::IdType::CREATE_GAME:
+	{
+		room_.id = as_fixed_<STOCMsg::CreateGame>().id;
+		shard_.on_room_created(room_);
+		return true;
+	}
+	case STOCMsg::IdType::TYPE_CHANGE:
+	{
+		auto const type_change = as_fixed_<STOCMsg::TypeChange>();
+		if((type_change.value & 0xFU) > 6U) // NOLINT
+		{
+			stats.server_errors++;
+			return false;
+		}
+		stats.join_time.record(Clock::now() - started_);
+		auto const& options = shard_.options();
+		{
+			auto msg = CTOSMsg::make_dynamic(CTOSMsg::IdType::UPDATE_DECK);
+			msg.write(static_cast<uint32_t>(options.deck_size));
+			msg.write<uint32_t>(0U); // No sidedeck for now.
+			for(size_t i = 0U; i < options.deck_size; i++)
+				msg.write<uint32_t>(options.deck_ptr[i]);
+			send_msg_(msg);
+		}
+		send_msg_(CTOSMsg::make_fixed(CTOSMsg::Ready{}));
+		return true;
+	}
+	case STOCMsg::IdType::PLAYER_CHANGE:
+	{
+		if(!hosting_)
+			return true;
+		auto const player_change = as_fixed_<STOCMsg::PlayerChange>();
+		auto const pos = static_cast<uint8_t>(player_change.value >> 4U);
+		auto const state = static_cast<uint8_t>(player_change.value & 0xFU);
+		if(pos > 6U) // NOLINT
+			return true;
+		if(state == 0x9U) // NOLINT: Ready.
+			ready_mask_ |= static_cast<uint8_t>(1U << pos);
+		else
+			ready_mask_ &= static_cast<uint8_t>(~(1U << pos));
+		unsigned ready = 0U;
+		for(auto m = ready_mask_; m != 0U; m &= m - 1U)
+			ready++;
+		if(ready == room_.kind.t0_count + room_.kind.t1_count)
+			send_msg_(CTOSMsg::make_fixed(CTOSMsg::TryStart{}));
+		return true;
+	}
+	case STOCMsg::IdType::DUEL_START:
+	{
+		stats.duels_started++;
+		return true;
+	}
+	case STOCMsg::IdType::DUEL_END:
+	{
+		stats.duels_ended++;
+		return false;
+	}
+	case STOCMsg::IdType::REMATCH:
+	{
+		send_msg_(CTOSMsg::make_fixed(CTOSMsg::Rematch{0U}));
+		return true;
+	}
+	default:
+	{
+		return true;
+	}
+	}
+}
+
+auto LoadClient::handle_game_msg_() noexcept -> bool
+{
+	using namespace YGOPro;
+	auto& stats = shard_.stats();
+	if(awaiting_reply_)
+	{
+		stats.response_latency.record(Clock::now() - responded_);
+		awaiting_reply_ = false;
+	}
+	if(body_.empty())
+		return true;
+	auto const core_msg = static_cast<CoreMsg>(body_[0U]);
+	if(core_msg == CoreMsg::RETRY)
+	{
+		// The server rejected our last answer; the policy would just repeat
+		// it, so there's no point in going on.
+		stats.unsupported_requests++;
+		return false;
+	}
+	if(!is_request(core_msg))
+		return true;
+	auto& answer = shard_.answer_buffer();
+	auto const& options = shard_.options();
+	if(!first_option_answer(body_.data(), body_.size(), options.deck_ptr,
+	                        options.deck_size, answer))
+	{
+		stats.unsupported_requests++;
+		return false;
+	}
+	auto msg = CTOSMsg::make_dynamic(CTOSMsg::RESPONSE);
+	msg.write(answer.data(), answer.size());
+	send_msg_(msg);
+	stats.responses++;
+	responded_ = Clock::now();
+	awaiting_reply_ = true;
+	return true;
+}
+
+// Shard
+
+Shard::Shard(LoadGenerator::Options const& options,
+             tcp::resolver::results_type endpoints, uint32_t rooms,
+             Clock::duration interval, unsigned seed)
+	: options_(options)
+	, endpoints_(std::move(endpoints))
+	, arrival_timer_(io_)
+	, deadline_timer_(io_)
+	, interval_(interval)
+	, rooms_left_(rooms)
+	, live_clients_(0U)
+	, stopping_(false)
+	, rng_(seed)
+	, pick_kind_(kind_weights(options.mix))
+{}
+
+auto Shard::run() -> void
+{
+	next_arrival_ = Clock::now();
+	schedule_arrival_();
+	if(options_.duration != 0U)
+	{
+		deadline_timer_.expires_after(std::chrono::seconds(options_.duration));
+		deadline_timer_.async_wait(
+			[this](boost::system::error_code ec)
+			{
+				if(ec)
+					return;
+				stopping_ = true;
+				arrival_timer_.cancel();
+				for(auto& client : clients_)
+					client.close();
+			});
+	}
+	io_.run();
+}
+
+auto Shard::on_room_created(Room& room) noexcept -> void
+{
+	auto const players = room.kind.t0_count + room.kind.t1_count;
+	for(int i = 1; i < players; i++)
+		spawn_(room, false);
+}
+
+auto Shard::on_client_closed() noexcept -> void
+{
+	live_clients_--;
+	maybe_finish_();
+}
+
+auto Shard::schedule_arrival_() noexcept -> void
+{
+	if(rooms_left_ == 0U || stopping_)
+	{
+		maybe_finish_();
+		return;
+	}
+	arrival_timer_.expires_at(next_arrival_);
+	arrival_timer_.async_wait(
+		[this](boost::system::error_code ec)
+		{
+			if(ec)
+				return;
+			next_arrival_ += interval_;
+			rooms_left_--;
+			collect_();
+			auto& room = rooms_.emplace_back(
+				Room{options_.mix[pick_kind_(rng_)], 0U, 0U});
+			stats_.rooms++;
+			spawn_(room, true);
+			schedule_arrival_();
+		});
+}
+
+auto Shard::spawn_(Room& room, bool hosting) noexcept -> void
+{
+	if(stopping_)
+		return;
+	auto& client = clients_.emplace_back(*this, room, hosting);
+	room.clients++;
+	stats_.clients++;
+	live_clients_++;
+	client.start();
+}
+
+auto Shard::maybe_finish_() noexcept -> void
+{
+	if(live_clients_ == 0U && (rooms_left_ == 0U || stopping_))
+		deadline_timer_.cancel();
+}
+
+auto Shard::collect_() noexcept -> void
+{
+	clients_.remove_if(
+		[](LoadClient& client)
+		{
+			if(!client.done())
+				return false;
+			client.room().clients--;
+			return true;
+		});
+	rooms_.remove_if([](Room const& room) { return room.clients == 0U; });
+}
+
+auto print_latency(char const* name, LatencyHistogram const& h) noexcept
+	-> void
+{
+	std::printf(
+		"%s (ms): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f (%llu samples).\n",
+		name, to_ms(h.percentile(50.0)), to_ms(h.percentile(90.0)),
+		to_ms(h.percentile(99.0)), to_ms(h.max()),
+		static_cast<unsigned long long>(h.count()));
+}
+
+} // namespace
+
+auto LoadGenerator::parse_mix(std::string_view str) -> std::vector<RoomKind>
+{
+	std::vector<RoomKind> mix;
+	while(!str.empty())
+	{
+		auto const comma = str.find(',');
+		auto const item = str.substr(0U, comma);
+		str = comma == std::string_view::npos ? std::string_view{}
+		                                      : str.substr(comma + 1U);
+		// <t0>v<t1>[:<weight>]
+		auto const v = item.find('v');
+		auto const colon = item.find(':');
+		if(v == std::string_view::npos || (colon != std::string_view::npos &&
+		                                   colon < v))
+			throw std::invalid_argument(std::string(item));
+		auto const t0 = parse_uint(item.substr(0U, v));
+		auto const t1 = parse_uint(item.substr(
+			v + 1U, colon == std::string_view::npos ? colon : colon - v - 1U));
+		auto const weight = colon == std::string_view::npos
+		                        ? uint64_t{1U}
+		                        : parse_uint(item.substr(colon + 1U));
+		if(t0 == 0U || t1 == 0U || t0 + t1 > 6U || weight == 0U) // NOLINT
+			throw std::invalid_argument(std::string(item));
+		mix.push_back(RoomKind{static_cast<uint8_t>(t0),
+		                       static_cast<uint8_t>(t1),
+		                       static_cast<uint32_t>(weight)});
+	}
+	if(mix.empty())
+		throw std::invalid_argument("empty room mix");
+	return mix;
+}
+
+LoadGenerator::LoadGenerator(Options options) : options_(std::move(options))
+{}
+
+auto LoadGenerator::run() -> void
+{
+	if(!(options_.arrival_rate > 0.0))
+		throw std::invalid_argument("arrival rate must be positive");
+	auto const endpoints = [&]()
+	{
+		boost::asio::io_context io_context;
+		tcp::resolver resolver(io_context);
+		return resolver.resolve(options_.host, options_.port);
+	}();
+	auto const threads = std::max(options_.threads, 1U);
+	auto const interval = std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<double>(static_cast<double>(threads) /
+	                                  options_.arrival_rate));
+	std::vector<std::unique_ptr<Shard>> shards;
+	for(unsigned i = 0U; i < threads; i++)
+	{
+		auto const rooms =
+			options_.rooms / threads + (i < options_.rooms % threads ? 1U : 0U);
+		shards.emplace_back(
+			std::make_unique<Shard>(options_, endpoints, rooms, interval, i));
+	}
+	auto const start = Clock::now();
+	{
+		std::vector<std::thread> workers;
+		for(auto& shard : shards)
+			workers.emplace_back([&shard]() { shard->run(); });
+		for(auto& worker : workers)
+			worker.join();
+	}
+	auto const elapsed = std::chrono::duration<double>(Clock::now() - start);
+	Stats total;
+	for(auto& shard : shards)
+		total.merge(shard->stats());
+	auto const errors = total.connect_errors + total.io_errors +
+	                    total.server_errors + total.unsupported_requests;
+	std::printf("Load generator ran for %.1fs on %u threads.\n",
+	            elapsed.count(), threads);
+	std::printf("Rooms: %llu opened, %llu duels started, %llu ended.\n",
+	            static_cast<unsigned long long>(total.rooms),
+	            static_cast<unsigned long long>(total.duels_started),
+	            static_cast<unsigned long long>(total.duels_ended));
+	std::printf("Clients: %llu, %zu bytes each plus socket buffers.\n",
+	            static_cast<unsigned long long>(total.clients),
+	            sizeof(LoadClient));
+	print_latency("Join time", total.join_time);
+	print_latency("Response latency", total.response_latency);
+	std::printf("Errors: %llu connect, %llu io, %llu server, %llu unsupported "
+	            "requests (%.2f%% of clients).\n",
+	            static_cast<unsigned long long>(total.connect_errors),
+	            static_cast<unsigned long long>(total.io_errors),
+	            static_cast<unsigned long long>(total.server_errors),
+	            static_cast<unsigned long long>(total.unsupported_requests),
+	            total.clients != 0U ? 100.0 * static_cast<double>(errors) /
+	                                      static_cast<double>(total.clients)
+	                                : 0.0);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_LOADGEN_HPP
+#define EDOPRO_DESKBOT_LOADGEN_HPP
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint32_t
+#include <string_view>
+#include <vector>
+
+// Opens rooms against a server at a fixed arrival rate and fills them with
+// lightweight clients that play using the built-in first option policy
+// instead of a Core, then reports latencies and error rates.
+class LoadGenerator
+{
+public:
+	struct RoomKind
+	{
+		uint8_t t0_count;
+		uint8_t t1_count;
+		uint32_t weight;
+	};
+
+	struct Options
+	{
+		std::string_view host;
+		std::string_view port;
+		uint32_t const* deck_ptr;
+		size_t deck_size;
+		uint32_t rooms;      // Total amount of rooms to open.
+		double arrival_rate; // Rooms opened per second, across all threads.
+		uint32_t duration;   // Seconds before giving up, or 0 for no limit.
+		unsigned threads;
+		std::vector<RoomKind> mix;
+	};
+
+	// Parses a room mix such as "1v1:3,2v2:1". Throws std::invalid_argument.
+	static auto parse_mix(std::string_view str) -> std::vector<RoomKind>;
+
+	explicit LoadGenerator(Options options);
+
+	// Runs until every room finished or the duration elapsed, then prints the
+	// report to stdout. Throws if the server can't be resolved.
+	auto run() -> void;
+
+private:
+	Options options_;
+};
+
+#endif // EDOPRO_DESKBOT_LOADGEN_HPP
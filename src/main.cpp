@@ -3,16 +3,383 @@
  *
  * SPDX-License-Identifier: AGPL-3.0-or-later
  */
+#include <algorithm> // std::min
 #include <array>
 #include <boost/asio/connect.hpp>
 #include <cstdio>
+#include <deque>
 #include <fstream>
 #include <google/protobuf/stubs/common.h>
 #include <optional>
+#include <stdexcept>
+#include <thread>
 
+#ifdef __linux__
+#include <unistd.h> // sysconf
+#endif // __linux__
+
+#include "alloc_tracking.hpp"
+#include "answer_cache.hpp"
+#include "buffer_pool.hpp"
 #include "client.hpp"
+#include "io_bench.hpp"
+#include "key_value_args.hpp"
 #include "load_script.hpp"
+#include "loadgen.hpp"
+#include "observer.hpp"
 #include "parse_ydk.hpp"
+#include "record_writer.hpp"
+#include "script_directives.hpp"
+#include "tournament.hpp"
+
+// Whole string as a room id, throws otherwise.
+auto parse_room_id(std::string_view str) -> uint32_t
+{
+	auto const r = parse_uint(str);
+	if(r > UINT32_MAX)
+		throw std::invalid_argument(std::string(str));
+	return static_cast<uint32_t>(r);
+}
+
+// Parses a list of room ids such as "1,4,10-20", throws if malformed.
+auto parse_room_ids(std::string_view str) -> std::vector<uint32_t>
+{
+	std::vector<uint32_t> ids;
+	while(!str.empty())
+	{
+		auto const comma = str.find(',');
+		auto const item = std::string(str.substr(0U, comma));
+		str = comma == std::string_view::npos ? std::string_view{}
+		                                      : str.substr(comma + 1U);
+		auto const dash = item.find('-');
+		auto const first = parse_room_id(item.substr(0U, dash));
+		auto const last = dash == std::string::npos
+		                      ? first
+		                      : parse_room_id(item.substr(dash + 1U));
+		if(last < first)
+			throw std::invalid_argument(item);
+		for(uint64_t id = first; id <= last; id++)
+			ids.push_back(static_cast<uint32_t>(id));
+	}
+	return ids;
+}
+
+auto loadgen_main(int argc, char* argv[]) -> int
+{
+	auto const args = KeyValueArgs(argc, argv);
+	if(args.positional().size() != 1U)
+	{
+		std::fprintf(stderr, "Usage: loadgen <ydk> [host=localhost] "
+		                     "[port=7911] [rooms=100] [rate=10] [duration=0] "
+		                     "[threads=N] [mix=1v1:1]\n");
+		return 1;
+	}
+	try
+	{
+		auto const d = [&]()
+		{
+			auto f = std::ifstream{std::string(args.positional()[0U])};
+			return parse_ydk(f);
+		}();
+		auto const default_threads =
+			std::max(std::thread::hardware_concurrency(), 1U);
+		LoadGenerator(
+			LoadGenerator::Options{
+				args.get("host", "localhost"),
+				args.get("port", "7911"),
+				d.data(),
+				d.size(),
+				static_cast<uint32_t>(args.get_uint("rooms", 100U)),
+				args.get_double("rate", 10.0),
+				static_cast<uint32_t>(args.get_uint("duration", 0U)),
+				static_cast<unsigned>(
+					args.get_uint("threads", default_threads)),
+				LoadGenerator::parse_mix(args.get("mix", "1v1:1"))})
+			.run();
+	}
+	catch(std::exception& e)
+	{
+		std::fprintf(stderr, "Error while running load generator: %s\n",
+		             e.what());
+		return 1;
+	}
+	return 0;
+}
+
+// Parses a tournament entry such as "deck.ydk,script.lua", reading the deck.
+auto parse_tournament_entry(std::string_view str) -> Tournament::Entry
+{
+	auto const comma = str.find(',');
+	if(comma == std::string_view::npos)
+		throw std::invalid_argument(std::string(str));
+	auto f = std::ifstream{std::string(str.substr(0U, comma))};
+	if(!f.is_open())
+		throw std::invalid_argument(std::string(str.substr(0U, comma)));
+	return Tournament::Entry{std::string(str), parse_ydk(f),
+	                         std::string(str.substr(comma + 1U))};
+}
+
+auto tournament_main(int argc, char* argv[]) -> int
+{
+	auto const args = KeyValueArgs(argc, argv);
+	if(args.positional().size() < 2U)
+	{
+		std::fprintf(stderr, "Usage: tournament <ydk>,<script> "
+		                     "<ydk>,<script>... [games=10] [host=localhost] "
+		                     "[port=7911] [threads=N] [timeout=600] "
+		                     "[memo_capacity=65536]\n");
+		return 1;
+	}
+	try
+	{
+		std::vector<Tournament::Entry> entries;
+		for(auto const str : args.positional())
+			entries.emplace_back(parse_tournament_entry(str));
+		auto const default_threads =
+			std::max(std::thread::hardware_concurrency(), 1U);
+		Tournament(
+			Tournament::Options{
+				args.get("host", "localhost"),
+				args.get("port", "7911"),
+				std::move(entries),
+				static_cast<uint32_t>(args.get_uint("games", 10U)),
+				static_cast<uint32_t>(args.get_uint("timeout", 600U)),
+				static_cast<unsigned>(
+					args.get_uint("threads", default_threads)),
+				static_cast<size_t>(args.get_uint("memo_capacity", 1U << 16U))})
+			.run();
+	}
+	catch(std::exception& e)
+	{
+		std::fprintf(stderr, "Error while running tournament: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
+
+auto iobench_main(int argc, char* argv[]) -> int
+{
+	auto const args = KeyValueArgs(argc, argv);
+	if(args.positional().size() != 2U)
+	{
+		std::fprintf(stderr, "Usage: iobench <ydk> <script> [frames=100000] "
+		                     "[warmup=1000]\n");
+		return 1;
+	}
+	try
+	{
+		auto const d = [&]()
+		{
+			auto f = std::ifstream{std::string(args.positional()[0U])};
+			return parse_ydk(f);
+		}();
+		IoBenchmark(
+			IoBenchmark::Options{
+				d.data(), d.size(), args.positional()[1U],
+				static_cast<uint32_t>(args.get_uint("frames", 100000U)),
+				static_cast<uint32_t>(args.get_uint("warmup", 1000U))})
+			.run();
+	}
+	catch(std::exception& e)
+	{
+		std::fprintf(stderr, "Error while running I/O benchmark: %s\n",
+		             e.what());
+		return 1;
+	}
+	return 0;
+}
+
+// Closes the writer, so every record is accounted for, then reports it.
+auto close_and_report(RecordWriter& writer) noexcept -> void
+{
+	writer.close();
+	std::printf("Records: %llu written (%llu bytes), %llu dropped, %llu "
+	            "truncated streams.\n",
+	            static_cast<unsigned long long>(writer.records_written()),
+	            static_cast<unsigned long long>(writer.bytes_written()),
+	            static_cast<unsigned long long>(writer.records_dropped()),
+	            static_cast<unsigned long long>(writer.streams_truncated()));
+}
+
+auto observe_main(int argc, char* argv[]) -> int
+{
+	auto const args = KeyValueArgs(argc, argv);
+	auto const room_ids = [&]() -> std::vector<uint32_t>
+	{
+		if(args.positional().size() != 2U)
+			return {};
+		try
+		{
+			return parse_room_ids(args.positional()[1U]);
+		}
+		catch(std::exception const& /*unused*/)
+		{
+			return {};
+		}
+	}();
+	if(room_ids.empty())
+	{
+		std::fprintf(stderr, "Usage: observe <output> <rooms> [host=localhost] "
+		                     "[port=7911] [threads=N] [level=6] "
+		                     "[queue=65536] [rotate=0]\n");
+		return 1;
+	}
+	using boost::asio::ip::tcp;
+	std::optional<RecordWriter> writer;
+	std::deque<boost::asio::io_context> io_contexts;
+	std::deque<Observer> observers;
+	try
+	{
+		auto const threads = std::max<uint64_t>(
+			args.get_uint("threads", std::thread::hardware_concurrency()), 1U);
+		writer.emplace(RecordWriter::Options{
+			std::string(args.positional()[0U]),
+			static_cast<int>(args.get_uint("level", 6U)),
+			static_cast<size_t>(args.get_uint("queue", 1U << 16U)),
+			args.get_uint("rotate", 0U)});
+		for(uint64_t i = 0U; i < std::min<uint64_t>(threads, room_ids.size());
+		    i++)
+			io_contexts.emplace_back();
+		tcp::resolver resolver(io_contexts.front());
+		auto const endpoints = resolver.resolve(args.get("host", "localhost"),
+		                                        args.get("port", "7911"));
+		for(size_t i = 0U; i < room_ids.size(); i++)
+		{
+			auto& io_context = io_contexts[i % io_contexts.size()];
+			tcp::socket socket(io_context);
+			boost::asio::connect(socket, endpoints);
+			observers.emplace_back(std::move(socket),
+			                       Observer::Options{room_ids[i], &*writer});
+		}
+	}
+	catch(std::exception& e)
+	{
+		std::fprintf(stderr, "Error while initializing observers: %s\n",
+		             e.what());
+		return 1;
+	}
+	{
+		std::vector<std::thread> workers;
+		for(auto& io_context : io_contexts)
+			workers.emplace_back([&io_context]() { io_context.run(); });
+		for(auto& worker : workers)
+			worker.join();
+	}
+	Observer::Stats total{};
+	for(auto const& observer : observers)
+	{
+		auto const& stats = observer.stats();
+		total.duels += stats.duels;
+		total.msgs += stats.msgs;
+		total.catchup_msgs += stats.catchup_msgs;
+		total.encode_failures += stats.encode_failures;
+	}
+	auto const rooms = observers.size();
+	observers.clear();
+	close_and_report(*writer);
+	std::printf("Observed %llu duels in %zu rooms: %llu messages (%llu from "
+	            "catch-up), %llu encoding failures.\n",
+	            static_cast<unsigned long long>(total.duels), rooms,
+	            static_cast<unsigned long long>(total.msgs),
+	            static_cast<unsigned long long>(total.catchup_msgs),
+	            static_cast<unsigned long long>(total.encode_failures));
+	return 0;
+}
+
+// Resident memory of the process in bytes, or 0 if unknown.
+auto resident_bytes() noexcept -> uint64_t
+{
+#ifdef __linux__
+	auto f = std::ifstream{"/proc/self/statm"};
+	uint64_t size = 0U;
+	uint64_t resident = 0U;
+	if(!(f >> size >> resident))
+		return 0U;
+	return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+	return 0U;
+#endif // __linux__
+}
+
+auto fleet_main(int argc, char* argv[]) -> int
+{
+	auto const args = KeyValueArgs(argc, argv);
+	if(args.positional().size() != 2U)
+	{
+		std::fprintf(stderr, "Usage: fleet <ydk> <script> [clients=10000] "
+		                     "[host=localhost] [port=7911] [compact=1] "
+		                     "[settle=2]\n");
+		return 1;
+	}
+	using boost::asio::ip::tcp;
+	// NOTE: Declared before the clients, which borrow from and run on these.
+	BufferPool<YGOPro::STOCMsg> msg_pool(16U);
+	boost::asio::io_context io_context;
+	std::deque<Client> clients;
+	bool compact = true;
+	uint64_t before = 0U;
+	try
+	{
+		auto const d = [&]()
+		{
+			auto f = std::ifstream{std::string(args.positional()[0U])};
+			return parse_ydk(f);
+		}();
+		auto const script = args.positional()[1U];
+		auto const count = args.get_uint("clients", 10000U);
+		compact = args.get_uint("compact", 1U) != 0U;
+		tcp::resolver resolver(io_context);
+		auto const endpoints = resolver.resolve(args.get("host", "localhost"),
+		                                        args.get("port", "7911"));
+		before = resident_bytes();
+		for(uint64_t i = 0U; i < count; i++)
+		{
+			tcp::socket socket(io_context);
+			boost::system::error_code ec;
+			boost::asio::connect(socket, endpoints, ec);
+			if(ec)
+			{
+				std::fprintf(stderr, "Stopped at %llu clients: %s.\n",
+				             static_cast<unsigned long long>(i),
+				             ec.message().data());
+				break;
+			}
+			clients.emplace_back(
+				std::move(socket),
+				Client::Options{d.data(), d.size(), script, nullptr, nullptr,
+			                    0U, nullptr, nullptr, nullptr,
+			                    compact ? &msg_pool : nullptr});
+		}
+		// Let every client get through the lobby handshake and go idle.
+		io_context.run_for(std::chrono::seconds(args.get_uint("settle", 2U)));
+	}
+	catch(std::exception& e)
+	{
+		std::fprintf(stderr, "Error while running fleet: %s\n", e.what());
+		return 1;
+	}
+	auto const after = resident_bytes();
+	std::printf("Fleet: %zu idle clients in %s mode, %zu bytes each inline.\n",
+	            clients.size(), compact ? "compact" : "regular",
+	            sizeof(Client));
+	if(before != 0U && after != 0U && !clients.empty())
+	{
+		std::printf("Resident memory: %.1f MiB before, %.1f MiB after, %.2f "
+		            "KiB per client.\n",
+		            static_cast<double>(before) / (1024.0 * 1024.0),
+		            static_cast<double>(after) / (1024.0 * 1024.0),
+		            static_cast<double>(after - std::min(after, before)) /
+		                1024.0 / static_cast<double>(clients.size()));
+	}
+	if(compact)
+		std::printf("Message buffers left in the pool: %zu.\n",
+		            msg_pool.free_count());
+	for(auto& client : clients)
+		client.close();
+	io_context.restart();
+	io_context.run();
+	return 0;
+}
 
 auto main(int argc, char* argv[]) -> int
 {
@@ -21,30 +388,69 @@ auto main(int argc, char* argv[]) -> int
 	{
 		~_() { google::protobuf::ShutdownProtobufLibrary(); }
 	} on_exit;
-	if(argc != 3)
+	if(argc >= 2 && std::string_view(argv[1]) == "loadgen")
+		return loadgen_main(argc - 2, argv + 2);
+	if(argc >= 2 && std::string_view(argv[1]) == "observe")
+		return observe_main(argc - 2, argv + 2);
+	if(argc >= 2 && std::string_view(argv[1]) == "tournament")
+		return tournament_main(argc - 2, argv + 2);
+	if(argc >= 2 && std::string_view(argv[1]) == "iobench")
+		return iobench_main(argc - 2, argv + 2);
+	if(argc >= 2 && std::string_view(argv[1]) == "fleet")
+		return fleet_main(argc - 2, argv + 2);
+	auto const args = KeyValueArgs(argc - 1, argv + 1);
+	if(args.positional().size() != 2U)
 	{
 		std::fprintf(stderr, "You need to pass a ydk file as 2nd arg.\n");
 		std::fprintf(stderr, "You need to pass a script file as 3rd arg.\n");
+		std::fprintf(stderr, "Optionally, pass dataset=<path> [rotate=bytes] "
+		                     "[queue=records] to export training data.\n");
+		std::fprintf(stderr, "Optionally, pass memo_capacity=<entries> to "
+		                     "bound the answer cache.\n");
+		std::fprintf(stderr, "Optionally, pass room=<id> to join a room "
+		                     "instead of hosting one.\n");
 		return 1;
 	}
 	boost::asio::io_context io_context;
+	std::optional<RecordWriter> dataset;
+	std::optional<AnswerCache> answer_cache;
 	std::optional<Client> client;
 	try
 	{
 		auto const d = [&]()
 		{
-			auto f = std::ifstream{argv[1]};
+			auto f = std::ifstream{std::string(args.positional()[0U])};
 			return parse_ydk(f);
 		}();
+		if(auto const path = args.get("dataset", ""); !path.empty())
+		{
+			dataset.emplace(RecordWriter::Options{
+				std::string(path), 6,
+				static_cast<size_t>(args.get_uint("queue", 1U << 12U)),
+				args.get_uint("rotate", 1U << 28U)});
+		}
+		auto const script = args.positional()[1U];
+		if(auto const directives =
+		       parse_script_directives(load_script(nullptr, script));
+		   directives.memoize.any())
+		{
+			auto const capacity = args.get_uint("memo_capacity", 1U << 16U);
+			answer_cache.emplace(directives.memoize,
+			                     static_cast<size_t>(capacity));
+		}
 		auto const host = std::string_view("localhost");
 		auto const port = std::string_view("7911");
 		boost::asio::ip::tcp::resolver resolver(io_context);
 		auto endpoints = resolver.resolve(host, port);
 		boost::asio::ip::tcp::socket socket(io_context);
 		boost::asio::connect(socket, endpoints);
-		client.emplace(
-			std::move(socket),
-			Client::Options{d.data(), d.size(), std::string_view(argv[2])});
+		client.emplace(std::move(socket),
+		               Client::Options{
+		                   d.data(), d.size(), script,
+		                   dataset ? &*dataset : nullptr,
+		                   answer_cache ? &*answer_cache : nullptr,
+		                   static_cast<uint32_t>(args.get_uint("room", 0U)),
+		                   nullptr, nullptr, nullptr, nullptr});
 	}
 	catch(std::exception& e)
 	{
@@ -52,5 +458,8 @@ auto main(int argc, char* argv[]) -> int
 		return 1;
 	}
 	io_context.run();
+	if(dataset)
+		close_and_report(*dataset);
+	AllocTracking::print("Process", AllocTracking::totals());
 	return 0;
 }
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "observer.hpp"
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <cstdio>
+#include <cstring> // std::memcpy
+#include <google/protobuf/arena.h>
+#include <ygopen/codec/edo9300_ocgcore_encode.hpp>
+#include <ygopen/proto/duel/msg.hpp>
+#include <ygopen/server/basic_encode_context.hpp>
+
+#include "core_msg.hpp"
+#include "record_writer.hpp"
+
+constexpr uint8_t OBSERVER_TYPE = 7U;
+
+Observer::Observer(boost::asio::ip::tcp::socket socket, Options const& options)
+	: socket_(std::move(socket))
+	, room_id_(options.room_id)
+	, writer_(options.writer)
+	, catching_up_(false)
+	, duel_started_(false)
+	, stats_()
+{
+	send_msg_(YGOPro::make_player_info());
+	send_msg_(YGOPro::make_join_game(room_id_));
+	do_read_header_();
+}
+
+Observer::~Observer() = default;
+
+auto Observer::send_msg_(YGOPro::CTOSMsg msg) noexcept -> void
+{
+	bool const write_in_progress = !outgoing_.empty();
+	outgoing_.emplace(msg);
+	if(!write_in_progress)
+		do_write_();
+}
+
+auto Observer::do_write_() noexcept -> void
+{
+	auto const& msg = outgoing_.front();
+	auto b = boost::asio::buffer(msg.data(), msg.size());
+	boost::asio::async_write(
+		socket_, b,
+		[this](boost::system::error_code ec, size_t /*unused*/)
+		{
+			if(ec)
+			{
+				std::fprintf(stderr, "Observer %u do_write_: %s.\n", room_id_,
+			                 ec.message().data());
+				return;
+			}
+			outgoing_.pop();
+			if(!outgoing_.empty())
+				do_write_();
+		});
+}
+
+auto Observer::do_read_header_() noexcept -> void
+{
+	auto b = boost::asio::buffer(incoming_.header_data(),
+	                             YGOPro::STOCMsg::HEADER_SIZE);
+	boost::asio::async_read(
+		socket_, b,
+		[this](boost::system::error_code ec, size_t /*unused*/)
+		{
+			if(ec)
+			{
+				std::fprintf(stderr, "Observer %u do_read_header_: %s.\n",
+			                 room_id_, ec.message().data());
+				return;
+			}
+			YGOPro::STOCMsg::SizeType size{};
+			std::memcpy(&size, incoming_.header_data(), sizeof(size));
+			if(size == 0U || sizeof(size) + size > YGOPro::STOCMsg::MAX_LENGTH)
+			{
+				std::fprintf(stderr, "Observer %u: Invalid message size %u.\n",
+			                 room_id_, static_cast<unsigned>(size));
+				return;
+			}
+			do_read_body_();
+		});
+}
+
+auto Observer::do_read_body_() noexcept -> void
+{
+	auto b = boost::asio::buffer(incoming_.body_data(), incoming_.body_size());
+	boost::asio::async_read(
+		socket_, b,
+		[this](boost::system::error_code ec, size_t /*unused*/)
+		{
+			if(ec)
+			{
+				std::fprintf(stderr, "Observer %u do_read_body_: %s.\n",
+			                 room_id_, ec.message().data());
+				return;
+			}
+			if(handle_msg_())
+				do_read_header_();
+		});
+}
+
+auto Observer::handle_msg_() noexcept -> bool
+{
+	using namespace YGOPro;
+	switch(incoming_.type())
+	{
+	case STOCMsg::IdType::GAME_MSG:
+	{
+		record_(incoming_.body_data(), incoming_.body_size());
+		return true;
+	}
+	case STOCMsg::IdType::ERROR_MSG:
+	{
+		std::fprintf(stderr, "Observer %u: Server reported an error.\n",
+		             room_id_);
+		return false;
+	}
+	case STOCMsg::IdType::TYPE_CHANGE:
+	{
+		// Joining a room that has free slots makes us a duelist, move to the
+		// spectator seats.
+		auto const type_change = incoming_.as_fixed<STOCMsg::TypeChange>();
+		if((type_change.value & 0xFU) != OBSERVER_TYPE) // NOLINT
+			send_msg_(CTOSMsg::make_fixed(CTOSMsg::ToObserver{}));
+		return true;
+	}
+	case STOCMsg::IdType::DUEL_START:
+	{
+		start_duel_();
+		duel_started_ = true;
+		return true;
+	}
+	case STOCMsg::IdType::CATCHUP:
+	{
+		// Joined mid-duel: the whole duel so far is replayed to us, rebuild
+		// the encoding context from scratch while recording it. The server
+		// may announce the duel with DUEL_START first, that one is reused.
+		auto const catchup = incoming_.as_fixed<STOCMsg::Catchup>();
+		catching_up_ = catchup.catching_up != 0U;
+		if(catching_up_ && !duel_started_)
+			start_duel_();
+		duel_started_ = false;
+		return true;
+	}
+	case STOCMsg::IdType::DUEL_END:
+	{
+		end_duel_();
+		return false;
+	}
+	default:
+	{
+		return true;
+	}
+	}
+}
+
+auto Observer::start_duel_() noexcept -> void
+{
+	end_duel_();
+	stats_.duels++;
+	ctx_ = std::make_unique<YGOpen::Server::BasicEncodeContext>();
+	arena_.reset();
+}
+
+auto Observer::end_duel_() noexcept -> void
+{
+	if(ctx_)
+		writer_->end_stream(stream_());
+}
+
+auto Observer::stream_() const noexcept -> uint64_t
+{
+	return (uint64_t{room_id_} << 32U) | stats_.duels;
+}
+
+auto Observer::record_(uint8_t const* buffer, size_t size) noexcept -> void
+{
+	using namespace YGOpen::Codec;
+	using YGOPro::CoreMsg;
+	if(!ctx_ || size == 0U)
+		return;
+	if(static_cast<CoreMsg>(*buffer) == CoreMsg::WAITING)
+		return;
+	// The arena is shared with the writer, which serializes the messages in it
+	// on its own thread and frees it after writing the last one.
+	auto const r = Edo9300::OCGCore::encode_one(arena_.get(), *ctx_, buffer);
+	switch(r.state)
+	{
+	case EncodeOneResult::State::OK:
+	{
+		duel_started_ = false;
+		ctx_->parse(*r.msg);
+		stats_.msgs++;
+		if(catching_up_)
+			stats_.catchup_msgs++;
+		writer_->push(
+			RecordWriter::Record{stream_(), arena_.use(), r.msg, nullptr});
+		break;
+	}
+	case EncodeOneResult::State::UNKNOWN:
+	{
+		stats_.encode_failures++;
+		std::fprintf(stderr, "Observer %u: Regular encoding failed: %i.\n",
+		             room_id_, static_cast<int>(*buffer));
+		return;
+	}
+	default:
+		break;
+	}
+	assert(r.bytes_read == size);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_OBSERVER_HPP
+#define EDOPRO_DESKBOT_OBSERVER_HPP
+#include <boost/asio/ip/tcp.hpp>
+#include <memory>
+#include <queue>
+
+#include "ctosmsg.hpp"
+#include "record_writer.hpp"
+#include "stocmsg.hpp"
+
+namespace YGOpen::Server
+{
+
+class BasicEncodeContext;
+
+} // namespace YGOpen::Server
+
+// Joins a room as a spectator and streams every decoded game message to a
+// RecordWriter. Only the protocol codec is needed, there's no Core involved.
+class Observer
+{
+public:
+	struct Options
+	{
+		uint32_t room_id;
+		RecordWriter* writer;
+	};
+
+	struct Stats
+	{
+		uint64_t duels;
+		uint64_t msgs;
+		uint64_t catchup_msgs;
+		uint64_t encode_failures;
+	};
+
+	Observer(boost::asio::ip::tcp::socket socket, Options const& options);
+	~Observer();
+
+	Observer(const Observer&) = delete;
+	Observer(Observer&&) noexcept = delete;
+	auto operator=(const Observer&) -> Observer& = delete;
+	auto operator=(Observer&&) noexcept -> Observer& = delete;
+
+	[[nodiscard]] auto stats() const noexcept -> Stats const& { return stats_; }
+
+private:
+	YGOPro::STOCMsg incoming_;
+	std::queue<YGOPro::CTOSMsg> outgoing_;
+	boost::asio::ip::tcp::socket socket_;
+
+	uint32_t room_id_;
+	RecordWriter* writer_;
+	bool catching_up_;
+	bool duel_started_; // DUEL_START seen but nothing recorded after it.
+	Stats stats_;
+
+	std::unique_ptr<YGOpen::Server::BasicEncodeContext> ctx_;
+	// Shared with the writer, holds the last few recorded messages.
+	RecordArena arena_;
+
+	auto send_msg_(YGOPro::CTOSMsg msg) noexcept -> void;
+	auto do_write_() noexcept -> void;
+
+	auto do_read_header_() noexcept -> void;
+	auto do_read_body_() noexcept -> void;
+
+	auto handle_msg_() noexcept -> bool;
+	auto start_duel_() noexcept -> void;
+	auto end_duel_() noexcept -> void;
+	[[nodiscard]] auto stream_() const noexcept -> uint64_t;
+	auto record_(uint8_t const* buffer, size_t size) noexcept -> void;
+};
+
+#endif // EDOPRO_DESKBOT_OBSERVER_HPP
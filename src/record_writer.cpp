@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "record_writer.hpp"
+
+#include <cstdio>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message_lite.h>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace
+{
+
+constexpr size_t BATCH_BUFFER_RESERVE = 1U << 16U;
+// A typical encoded message is a couple hundred bytes, so a batch of them
+// fits a few blocks.
+constexpr size_t ARENA_START_BLOCK_SIZE = 1U << 13U;
+constexpr size_t ARENA_MAX_BLOCK_SIZE = 1U << 16U;
+
+auto write_varint(std::vector<uint8_t>& out, uint64_t value) noexcept -> void
+{
+	while(value >= 0x80U)
+	{
+		out.push_back(static_cast<uint8_t>(value | 0x80U));
+		value >>= 7U;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+auto write_entry(std::vector<uint8_t>& out, uint64_t stream,
+                 RecordWriter::Kind kind,
+                 google::protobuf::MessageLite const& msg) noexcept -> void
+{
+	auto const size = msg.ByteSizeLong();
+	write_varint(out, stream);
+	write_varint(out, static_cast<uint64_t>(kind));
+	write_varint(out, size);
+	auto const offset = out.size();
+	out.resize(offset + size);
+	msg.SerializeWithCachedSizesToArray(out.data() + offset);
+}
+
+auto write_truncated(std::vector<uint8_t>& out, uint64_t stream) noexcept
+	-> void
+{
+	write_varint(out, stream);
+	write_varint(out, static_cast<uint64_t>(RecordWriter::Kind::TRUNCATED));
+	write_varint(out, 0U);
+}
+
+} // namespace
+
+RecordWriter::RecordWriter(Options const& options)
+	: path_(options.path)
+	, compression_level_(options.compression_level)
+	, queue_capacity_(options.queue_capacity)
+	, rotate_bytes_(options.rotate_bytes)
+	, file_(nullptr)
+	, file_index_(0U)
+	, stop_(false)
+	, records_written_(0U)
+	, records_dropped_(0U)
+	, streams_truncated_(0U)
+	, bytes_written_(0U)
+{
+	if(!open_next_())
+		throw std::runtime_error("Unable to open " + path_);
+	queue_.reserve(queue_capacity_);
+	thread_ = std::thread(&RecordWriter::run_, this);
+}
+
+RecordWriter::~RecordWriter()
+{
+	close();
+}
+
+auto RecordWriter::push(Record record) noexcept -> bool
+{
+	{
+		std::scoped_lock lock(mtx_);
+		if(stop_)
+		{
+			records_dropped_.fetch_add(1U, std::memory_order_relaxed);
+			return false;
+		}
+		// Once a stream loses a record the rest of it is useless.
+		if(queue_.size() >= queue_capacity_ ||
+		   truncated_.count(record.stream) != 0U)
+		{
+			records_dropped_.fetch_add(1U, std::memory_order_relaxed);
+			truncate_(record.stream);
+			return false;
+		}
+		queue_.emplace_back(std::move(record));
+	}
+	cv_.notify_one();
+	return true;
+}
+
+auto RecordWriter::truncate(uint64_t stream) noexcept -> void
+{
+	std::scoped_lock lock(mtx_);
+	truncate_(stream);
+}
+
+auto RecordWriter::end_stream(uint64_t stream) noexcept -> void
+{
+	std::scoped_lock lock(mtx_);
+	truncated_.erase(stream);
+}
+
+auto RecordWriter::close() noexcept -> void
+{
+	{
+		std::scoped_lock lock(mtx_);
+		stop_ = true;
+	}
+	cv_.notify_one();
+	if(!thread_.joinable())
+		return;
+	thread_.join();
+	if(file_ != nullptr)
+		gzclose(file_);
+	file_ = nullptr;
+}
+
+auto RecordWriter::records_written() const noexcept -> uint64_t
+{
+	return records_written_.load(std::memory_order_relaxed);
+}
+
+auto RecordWriter::records_dropped() const noexcept -> uint64_t
+{
+	return records_dropped_.load(std::memory_order_relaxed);
+}
+
+auto RecordWriter::streams_truncated() const noexcept -> uint64_t
+{
+	return streams_truncated_.load(std::memory_order_relaxed);
+}
+
+auto RecordWriter::bytes_written() const noexcept -> uint64_t
+{
+	return bytes_written_.load(std::memory_order_relaxed);
+}
+
+auto RecordWriter::truncate_(uint64_t stream) noexcept -> void
+{
+	if(!truncated_.insert(stream).second)
+		return;
+	truncations_.push_back(stream);
+	streams_truncated_.fetch_add(1U, std::memory_order_relaxed);
+}
+
+auto RecordWriter::open_next_() noexcept -> bool
+{
+	if(file_ != nullptr)
+		gzclose(file_);
+	auto const path = file_index_ == 0U
+	                      ? path_
+	                      : path_ + "." + std::to_string(file_index_);
+	file_index_++;
+	file_ = gzopen(path.data(), "wb");
+	if(file_ == nullptr)
+	{
+		std::fprintf(stderr, "RecordWriter: Unable to open %s.\n", path.data());
+		return false;
+	}
+	gzsetparams(file_, compression_level_, Z_DEFAULT_STRATEGY);
+	return true;
+}
+
+auto RecordWriter::run_() noexcept -> void
+{
+	std::vector<Record> batch;
+	batch.reserve(queue_capacity_);
+	std::vector<uint64_t> truncations;
+	std::vector<uint8_t> buffer;
+	buffer.reserve(BATCH_BUFFER_RESERVE);
+	for(;;)
+	{
+		bool last = false;
+		{
+			std::unique_lock lock(mtx_);
+			cv_.wait(lock, [&]() { return stop_ || !queue_.empty(); });
+			// When stop_ is set and no records are left, pending TRUNCATED
+			// entries are written one last time.
+			last = queue_.empty();
+			// Take everything queued so far and write it in one go.
+			std::swap(batch, queue_);
+			std::swap(truncations, truncations_);
+		}
+		if(last && truncations.empty())
+			return;
+		buffer.clear();
+		for(auto const stream : truncations)
+			write_truncated(buffer, stream);
+		for(auto const& record : batch)
+		{
+			write_entry(buffer, record.stream, Kind::MSG, *record.msg);
+			if(record.answer != nullptr)
+				write_entry(buffer, record.stream, Kind::ANSWER,
+				            *record.answer);
+		}
+		auto const size = static_cast<unsigned>(buffer.size());
+		if(file_ == nullptr || gzwrite(file_, buffer.data(), size) == 0)
+		{
+			std::fprintf(stderr, "RecordWriter: Failed to write %zu bytes.\n",
+			             buffer.size());
+			records_dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+			// Retry the TRUNCATED entries with the next batch, and add the
+			// streams just cut short.
+			std::scoped_lock lock(mtx_);
+			truncations_.insert(truncations_.end(), truncations.begin(),
+			                    truncations.end());
+			for(auto const& record : batch)
+				truncate_(record.stream);
+		}
+		else
+		{
+			records_written_.fetch_add(batch.size(), std::memory_order_relaxed);
+			bytes_written_.fetch_add(buffer.size(), std::memory_order_relaxed);
+		}
+		if(file_ != nullptr && rotate_bytes_ != 0U &&
+		   static_cast<uint64_t>(gzoffset(file_)) >= rotate_bytes_)
+			open_next_();
+		// Arenas (and the messages in them) are usually freed here, off the
+		// threads that produced them.
+		batch.clear();
+		truncations.clear();
+		if(last)
+			return;
+	}
+}
+
+RecordArena::RecordArena() noexcept : msgs_(0U) {}
+
+auto RecordArena::get() noexcept -> google::protobuf::Arena&
+{
+	if(!arena_ || msgs_ == BATCH)
+	{
+		google::protobuf::ArenaOptions options;
+		options.start_block_size = ARENA_START_BLOCK_SIZE;
+		options.max_block_size = ARENA_MAX_BLOCK_SIZE;
+		arena_ = std::make_shared<google::protobuf::Arena>(options);
+		msgs_ = 0U;
+	}
+	return *arena_;
+}
+
+auto RecordArena::use() noexcept
+	-> std::shared_ptr<google::protobuf::Arena> const&
+{
+	msgs_++;
+	return arena_;
+}
+
+auto RecordArena::reset() noexcept -> void
+{
+	arena_.reset();
+}
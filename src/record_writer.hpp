@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_RECORD_WRITER_HPP
+#define EDOPRO_DESKBOT_RECORD_WRITER_HPP
+#include <atomic>
+#include <condition_variable>
+#include <cstdint> // uint8_t, uint64_t
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+struct gzFile_s;
+
+namespace google::protobuf
+{
+
+class Arena;
+class MessageLite;
+
+} // namespace google::protobuf
+
+// Streams protobuf messages to gzip-compressed files from a background
+// thread. Producers share the arena owning each message with the writer, so
+// neither serialization nor compression happen on their threads. An arena may
+// hold many messages, it's freed once the last record using it is written.
+// The queue is bounded: when the writer can't keep up records are dropped
+// instead of making producers wait. A stream that loses a record is truncated:
+// the rest of its records are dropped too and a TRUNCATED entry is written for
+// it, so consumers can discard the whole stream.
+//
+// The (uncompressed) file is a sequence of entries, each one being:
+//     varint stream id, varint kind, varint size, `size` bytes of message.
+// Streams let many duels be interleaved in the same file. A TRUNCATED entry
+// may come after other entries of its stream, even in a later rotated file.
+class RecordWriter
+{
+public:
+	enum class Kind : uint8_t
+	{
+		MSG = 1U,    // YGOpen::Proto::Duel::Msg
+		ANSWER = 2U, // YGOpen::Proto::Duel::Answer to the preceding MSG.
+		TRUNCATED = 3U, // Empty, the stream lost records.
+	};
+
+	struct Record
+	{
+		uint64_t stream;
+		std::shared_ptr<google::protobuf::Arena> arena;
+		google::protobuf::MessageLite const* msg;
+		google::protobuf::MessageLite const* answer; // Optional.
+	};
+
+	struct Options
+	{
+		std::string path;
+		int compression_level;
+		size_t queue_capacity; // In records.
+		// Compressed size after which a new file is started, or 0 to always
+		// write to `path`. Files after the first are named `path.1`, `path.2`
+		// and so on.
+		uint64_t rotate_bytes;
+	};
+
+	// Throws std::runtime_error if the file can't be opened.
+	explicit RecordWriter(Options const& options);
+	// Calls close().
+	~RecordWriter();
+
+	RecordWriter(const RecordWriter&) = delete;
+	RecordWriter(RecordWriter&&) noexcept = delete;
+	auto operator=(const RecordWriter&) -> RecordWriter& = delete;
+	auto operator=(RecordWriter&&) noexcept -> RecordWriter& = delete;
+
+	// Thread-safe. Returns false if the record was dropped.
+	auto push(Record record) noexcept -> bool;
+
+	// Thread-safe. Drops the rest of the stream, for producers that know it
+	// has a gap. A TRUNCATED entry is written for it.
+	auto truncate(uint64_t stream) noexcept -> void;
+
+	// Thread-safe. Call once a stream won't get any more records, so the
+	// writer can forget whether it was truncated.
+	auto end_stream(uint64_t stream) noexcept -> void;
+
+	// Writes out every record pushed so far and closes the file, records
+	// pushed afterwards are dropped. Counters are final once this returns.
+	auto close() noexcept -> void;
+
+	[[nodiscard]] auto records_written() const noexcept -> uint64_t;
+	[[nodiscard]] auto records_dropped() const noexcept -> uint64_t;
+	[[nodiscard]] auto streams_truncated() const noexcept -> uint64_t;
+	[[nodiscard]] auto bytes_written() const noexcept -> uint64_t;
+
+private:
+	std::string const path_;
+	int const compression_level_;
+	size_t const queue_capacity_;
+	uint64_t const rotate_bytes_;
+	gzFile_s* file_;
+	unsigned file_index_;
+	std::mutex mtx_;
+	std::condition_variable cv_;
+	std::vector<Record> queue_;
+	std::unordered_set<uint64_t> truncated_;
+	std::vector<uint64_t> truncations_; // TRUNCATED entries to write.
+	bool stop_;
+	std::atomic<uint64_t> records_written_;
+	std::atomic<uint64_t> records_dropped_;
+	std::atomic<uint64_t> streams_truncated_;
+	std::atomic<uint64_t> bytes_written_;
+	std::thread thread_;
+
+	// Must be called with mtx_ held.
+	auto truncate_(uint64_t stream) noexcept -> void;
+	auto open_next_() noexcept -> bool;
+	auto run_() noexcept -> void;
+};
+
+// Hands out arenas to be shared with a RecordWriter, a new one every BATCH
+// messages, so a record doesn't cost an arena and its control block.
+class RecordArena
+{
+public:
+	static constexpr uint32_t BATCH = 64U;
+
+	RecordArena() noexcept;
+
+	// Arena for the next message, may be the same as for the previous ones.
+	auto get() noexcept -> google::protobuf::Arena&;
+	// Marks the message created in get() as recorded.
+	auto use() noexcept -> std::shared_ptr<google::protobuf::Arena> const&;
+	// Drops our reference, the writer frees the arena when done with it.
+	auto reset() noexcept -> void;
+
+private:
+	std::shared_ptr<google::protobuf::Arena> arena_;
+	uint32_t msgs_;
+};
+
+#endif // EDOPRO_DESKBOT_RECORD_WRITER_HPP
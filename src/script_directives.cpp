@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "script_directives.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "core_msg.hpp"
+
+namespace
+{
+
+constexpr auto PREFIX = std::string_view("-- deskbot:");
+
+auto next_word(std::string_view& str) noexcept -> std::string_view
+{
+	auto const begin = str.find_first_not_of(" \t\r");
+	if(begin == std::string_view::npos)
+	{
+		str = {};
+		return {};
+	}
+	str.remove_prefix(begin);
+	auto const end = std::min(str.find_first_of(" \t\r"), str.size());
+	auto const word = str.substr(0U, end);
+	str.remove_prefix(end);
+	return word;
+}
+
+} // namespace
+
+auto parse_script_directives(std::string_view script) -> ScriptDirectives
+{
+	ScriptDirectives directives;
+	bool subscribed = false;
+	while(!script.empty())
+	{
+		auto const eol = std::min(script.find('\n'), script.size());
+		auto line = script.substr(0U, eol);
+		script.remove_prefix(std::min(eol + 1U, script.size()));
+		auto const begin = line.find_first_not_of(" \t");
+		if(begin == std::string_view::npos ||
+		   line.substr(begin, PREFIX.size()) != PREFIX)
+			continue;
+		line.remove_prefix(begin + PREFIX.size());
+		auto const directive = next_word(line);
+		ScriptDirectives::CoreMsgSet* set = nullptr;
+		if(directive == "memoize")
+		{
+			set = &directives.memoize;
+		}
+		else if(directive == "subscribe")
+		{
+			// First subscription narrows down the default of everything.
+			if(!subscribed)
+				directives.subscribe.reset();
+			subscribed = true;
+			set = &directives.subscribe;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown directive: " +
+			                            std::string(directive));
+		}
+		for(auto name = next_word(line); !name.empty(); name = next_word(line))
+		{
+			auto const msg = YGOPro::core_msg_from_name(name);
+			if(!msg.has_value())
+				throw std::invalid_argument("Unknown core message: " +
+				                            std::string(name));
+			set->set(static_cast<size_t>(*msg));
+		}
+	}
+	return directives;
+}
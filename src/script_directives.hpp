@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_SCRIPT_DIRECTIVES_HPP
+#define EDOPRO_DESKBOT_SCRIPT_DIRECTIVES_HPP
+#include <bitset>
+#include <string_view>
+
+// Hints a script gives to edopro-deskbot (and not to the Core) through Lua
+// comments of the form:
+//     -- deskbot: <directive> <core message name>...
+// Supported directives:
+//     memoize: Answers to these requests only depend on the request itself,
+//              so identical requests can reuse the previous answer. Only
+//              the request bytes are compared: life points, hand sizes or
+//              the rest of the board are not, so requests such as
+//              select_idlecmd whose answer usually depends on them should
+//              not be declared.
+//     subscribe: Messages the script wants to analyze. Others still update
+//                the encoding context but never reach the Core. Requests are
+//                always analyzed. Without this directive every message is.
+struct ScriptDirectives
+{
+	using CoreMsgSet = std::bitset<256U>;
+
+	CoreMsgSet memoize;
+	CoreMsgSet subscribe = CoreMsgSet().set();
+};
+
+// Throws std::invalid_argument on unknown directives or message names.
+auto parse_script_directives(std::string_view script) -> ScriptDirectives;
+
+#endif // EDOPRO_DESKBOT_SCRIPT_DIRECTIVES_HPP
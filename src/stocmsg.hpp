@@ -29,7 +29,7 @@ public:
 		ORDER_RESULT = 0x6,
 		// CHANGE_SIDE   = 0x7, // TODO: Are we going to handle side decking?
 		// WAITING_SIDE  = 0x8,
-		// CREATE_GAME   = 0x11,
+		CREATE_GAME = 0x11,
 		JOIN_GAME = 0x12,
 		TYPE_CHANGE = 0x13,
 		// LEAVE_GAME    = 0x14,
@@ -39,9 +39,9 @@ public:
 		// TIME_LIMIT    = 0x18,
 		// PLAYER_ENTER = 0x20,
 		PLAYER_CHANGE = 0x21,
-		// WATCH_CHANGE  = 0x22,
+		WATCH_CHANGE = 0x22,
 		// NEW_REPLAY    = 0x30,
-		// CATCHUP       = 0xF0,
+		CATCHUP = 0xF0,
 		REMATCH = 0xF1,
 		// REMATCH_WAIT  = 0xF2,
 		// CHAT_2 = 0xF3,
@@ -71,6 +71,12 @@ public:
 		uint32_t code;
 	};
 
+	struct CreateGame
+	{
+		static constexpr auto ID = IdType::CREATE_GAME;
+		uint32_t id;
+	};
+
 	struct JoinGame
 	{
 		static constexpr auto ID = IdType::JOIN_GAME;
@@ -89,6 +95,18 @@ public:
 		uint8_t value;
 	};
 
+	struct WatchChange
+	{
+		static constexpr auto ID = IdType::WATCH_CHANGE;
+		uint16_t count;
+	};
+
+	struct Catchup
+	{
+		static constexpr auto ID = IdType::CATCHUP;
+		uint8_t catching_up;
+	};
+
 	constexpr STOCMsg() noexcept : bytes_() {}
 
 	[[nodiscard]] auto body_data() const noexcept -> uint8_t const*
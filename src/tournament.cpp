@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#include "tournament.hpp"
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "answer_cache.hpp"
+#include "client.hpp"
+#include "histogram.hpp"
+#include "load_script.hpp"
+#include "script_directives.hpp"
+
+namespace
+{
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+using Outcome = Client::Result::Outcome;
+
+using AnswerCaches = std::vector<std::unique_ptr<AnswerCache>>;
+
+struct Match
+{
+	size_t host;
+	size_t guest;
+};
+
+// An entry taking part in a game, with the cache shared by all of its games.
+struct Player
+{
+	Tournament::Entry const& entry;
+	AnswerCache* answer_cache; // Null if its script memoizes nothing.
+};
+
+// Results of a pairing from the point of view of one of its entries.
+struct Record
+{
+	uint64_t wins{};
+	uint64_t losses{};
+	uint64_t draws{};
+
+	auto merge(Record const& other) noexcept -> void
+	{
+		wins += other.wins;
+		losses += other.losses;
+		draws += other.draws;
+	}
+
+	[[nodiscard]] auto games() const noexcept -> uint64_t
+	{
+		return wins + losses + draws;
+	}
+
+	// Draws count as half a win.
+	[[nodiscard]] auto win_rate() const noexcept -> double
+	{
+		return (static_cast<double>(wins) + static_cast<double>(draws) / 2.0) /
+		       static_cast<double>(games());
+	}
+};
+
+struct Stats
+{
+	size_t entries;
+	std::vector<Record> records; // [a * entries + b] is a against b.
+	std::vector<LatencyHistogram> decision_latency; // Per entry.
+	LatencyHistogram game_time;
+	uint64_t games{};
+	uint64_t aborted{};
+	uint64_t turns{};
+	uint32_t max_turns{};
+
+	explicit Stats(size_t n)
+		: entries(n)
+		, records(n * n)
+		, decision_latency(n)
+	{}
+
+	auto record(Match const& match, Client::Result const& host,
+	            Client::Result const& guest) noexcept -> void
+	{
+		if(host.outcome == Outcome::ABORTED ||
+		   guest.outcome == Outcome::ABORTED)
+		{
+			aborted++;
+			return;
+		}
+		auto& h = records[match.host * entries + match.guest];
+		auto& g = records[match.guest * entries + match.host];
+		switch(host.outcome)
+		{
+		case Outcome::WIN:
+			h.wins++;
+			g.losses++;
+			break;
+		case Outcome::LOSS:
+			h.losses++;
+			g.wins++;
+			break;
+		default:
+			h.draws++;
+			g.draws++;
+			break;
+		}
+		decision_latency[match.host].merge(host.decision_latency);
+		decision_latency[match.guest].merge(guest.decision_latency);
+		game_time.record(host.duration);
+		games++;
+		turns += host.turns;
+		max_turns = std::max(max_turns, host.turns);
+	}
+
+	auto merge(Stats const& other) noexcept -> void
+	{
+		for(size_t i = 0U; i < records.size(); i++)
+			records[i].merge(other.records[i]);
+		for(size_t i = 0U; i < entries; i++)
+			decision_latency[i].merge(other.decision_latency[i]);
+		game_time.merge(other.game_time);
+		games += other.games;
+		aborted += other.aborted;
+		turns += other.turns;
+		max_turns = std::max(max_turns, other.max_turns);
+	}
+};
+
+// A single game, owning both clients. Lives in the stack of a worker while
+// its io_context runs.
+class Game
+{
+public:
+	Game(boost::asio::io_context& io, tcp::resolver::results_type const& eps,
+	     Player host, Player guest)
+		: io_(io), endpoints_(eps), host_player_(host), guest_player_(guest)
+	{}
+
+	Game(const Game&) = delete;
+	Game(Game&&) noexcept = delete;
+	auto operator=(const Game&) -> Game& = delete;
+	auto operator=(Game&&) noexcept -> Game& = delete;
+
+	// Connects the hosting client, the other one joins once the room exists.
+	auto start() -> void
+	{
+		host_.emplace(connect_(),
+		              options_(host_player_, 0U, on_host_finished_));
+	}
+
+	auto close() noexcept -> void
+	{
+		if(host_)
+			host_->close();
+		if(guest_)
+			guest_->close();
+	}
+
+	[[nodiscard]] auto host_result() const noexcept
+		-> std::optional<Client::Result> const&
+	{
+		return host_result_;
+	}
+
+	[[nodiscard]] auto guest_result() const noexcept
+		-> std::optional<Client::Result> const&
+	{
+		return guest_result_;
+	}
+
+private:
+	boost::asio::io_context& io_;
+	tcp::resolver::results_type const& endpoints_;
+	Player const host_player_;
+	Player const guest_player_;
+	std::optional<Client> host_;
+	std::optional<Client> guest_;
+	std::optional<Client::Result> host_result_;
+	std::optional<Client::Result> guest_result_;
+
+	auto connect_() -> tcp::socket
+	{
+		tcp::socket socket(io_);
+		boost::asio::connect(socket, endpoints_);
+		return socket;
+	}
+
+	auto options_(Player player, uint32_t room_id,
+	              Client::FinishedCallback on_finished) noexcept
+		-> Client::Options
+	{
+		return Client::Options{player.entry.deck.data(),
+		                       player.entry.deck.size(),
+		                       player.entry.script,
+		                       nullptr,
+		                       player.answer_cache,
+		                       room_id,
+		                       this,
+		                       room_id == 0U ? on_room_created_ : nullptr,
+		                       on_finished,
+		                       nullptr};
+	}
+
+	// Stops as soon as the outcome is known; an aborted client voids the game
+	// so there's no point in waiting for the other one.
+	auto maybe_stop_() noexcept -> void
+	{
+		bool const aborted =
+			(host_result_ && host_result_->outcome == Outcome::ABORTED) ||
+			(guest_result_ && guest_result_->outcome == Outcome::ABORTED);
+		if(aborted || (host_result_ && (guest_result_ || !guest_)))
+			io_.stop();
+	}
+
+	static auto on_room_created_(void* user, uint32_t room_id) noexcept -> void
+	{
+		auto& game = *static_cast<Game*>(user);
+		try
+		{
+			game.guest_.emplace(game.connect_(),
+			                    game.options_(game.guest_player_, room_id,
+			                                  on_guest_finished_));
+		}
+		catch(std::exception const& e)
+		{
+			std::fprintf(stderr, "Unable to join room %u: %s\n", room_id,
+			             e.what());
+			game.io_.stop();
+		}
+	}
+
+	static auto on_host_finished_(void* user,
+	                              Client::Result const& result) noexcept -> void
+	{
+		auto& game = *static_cast<Game*>(user);
+		game.host_result_ = result;
+		game.maybe_stop_();
+	}
+
+	static auto on_guest_finished_(void* user,
+	                               Client::Result const& result) noexcept
+		-> void
+	{
+		auto& game = *static_cast<Game*>(user);
+		game.guest_result_ = result;
+		game.maybe_stop_();
+	}
+};
+
+auto play(Tournament::Options const& options, AnswerCaches const& caches,
+          tcp::resolver::results_type const& endpoints, Match const& match,
+          Stats& stats) noexcept -> void
+{
+	// NOTE: A fresh io_context per game, so nothing left over from a game
+	// that was cut short can interfere with the next one.
+	boost::asio::io_context io;
+	Game game(io, endpoints,
+	          Player{options.entries[match.host], caches[match.host].get()},
+	          Player{options.entries[match.guest], caches[match.guest].get()});
+	boost::asio::steady_timer deadline(io);
+	try
+	{
+		game.start();
+	}
+	catch(std::exception const& e)
+	{
+		std::fprintf(stderr, "Unable to host a game: %s\n", e.what());
+		stats.aborted++;
+		return;
+	}
+	if(options.timeout != 0U)
+	{
+		deadline.expires_after(std::chrono::seconds(options.timeout));
+		deadline.async_wait(
+			[&io](boost::system::error_code ec)
+			{
+				if(!ec)
+					io.stop();
+			});
+	}
+	io.run();
+	// Let the operations left pending complete before the clients (and the
+	// memory their handlers live in) go away.
+	game.close();
+	deadline.cancel();
+	io.restart();
+	io.run();
+	auto const& host = game.host_result();
+	auto const& guest = game.guest_result();
+	if(!host || !guest)
+	{
+		stats.aborted++;
+		return;
+	}
+	stats.record(match, *host, *guest);
+}
+
+auto print_report(Tournament::Options const& options, Stats const& total,
+                  double elapsed, unsigned threads) noexcept -> void
+{
+	auto const n = options.entries.size();
+	auto const hours = elapsed / 3600.0;
+	std::printf("Tournament: %zu entries, %u games per pairing, %llu games "
+	            "played (%llu aborted) in %.1fs on %u threads.\n",
+	            n, options.games, static_cast<unsigned long long>(total.games),
+	            static_cast<unsigned long long>(total.aborted), elapsed,
+	            threads);
+	if(hours > 0.0)
+		std::printf("Throughput: %.1f games/hour, %.1f games/hour/core.\n",
+		            static_cast<double>(total.games) / hours,
+		            static_cast<double>(total.games) / hours /
+		                static_cast<double>(threads));
+	std::printf("\nWin rate of row against column (draws count as half):\n");
+	std::printf("%4s", "");
+	for(size_t b = 0U; b < n; b++)
+		std::printf(" %7zu", b);
+	std::printf("\n");
+	for(size_t a = 0U; a < n; a++)
+	{
+		std::printf("%4zu", a);
+		for(size_t b = 0U; b < n; b++)
+		{
+			auto const& r = total.records[a * n + b];
+			if(r.games() == 0U)
+				std::printf(" %7s", "-");
+			else
+				std::printf(" %6.1f%%", 100.0 * r.win_rate());
+		}
+		std::printf("\n");
+	}
+	std::printf("\nEntries (decision latency in ms):\n");
+	std::printf("%4s %7s %7s %7s %7s %8s %8s %8s  %s\n", "", "wins", "losses",
+	            "draws", "rate", "p50", "p99", "max", "name");
+	for(size_t a = 0U; a < n; a++)
+	{
+		Record r;
+		for(size_t b = 0U; b < n; b++)
+			r.merge(total.records[a * n + b]);
+		auto const& h = total.decision_latency[a];
+		std::printf("%4zu %7llu %7llu %7llu %6.1f%% %8.2f %8.2f %8.2f  %s\n",
+		            a, static_cast<unsigned long long>(r.wins),
+		            static_cast<unsigned long long>(r.losses),
+		            static_cast<unsigned long long>(r.draws),
+		            r.games() != 0U ? 100.0 * r.win_rate() : 0.0,
+		            to_ms(h.percentile(50.0)), to_ms(h.percentile(99.0)),
+		            to_ms(h.max()), options.entries[a].name.data());
+	}
+	auto const& t = total.game_time;
+	std::printf("\nGame length: %.1f turns on average, %u at most. "
+	            "Duration (s): p50 %.2f, p90 %.2f, max %.2f.\n",
+	            total.games != 0U ? static_cast<double>(total.turns) /
+	                                    static_cast<double>(total.games)
+	                              : 0.0,
+	            total.max_turns, to_ms(t.percentile(50.0)) / 1000.0,
+	            to_ms(t.percentile(90.0)) / 1000.0, to_ms(t.max()) / 1000.0);
+}
+
+} // namespace
+
+Tournament::Tournament(Options options) : options_(std::move(options)) {}
+
+auto Tournament::run() -> void
+{
+	auto const n = options_.entries.size();
+	if(n < 2U || options_.games == 0U)
+		throw std::invalid_argument("nothing to play");
+	auto const endpoints = [&]()
+	{
+		boost::asio::io_context io_context;
+		tcp::resolver resolver(io_context);
+		return resolver.resolve(options_.host, options_.port);
+	}();
+	// Entries play many games, so answers they memoize are kept across them.
+	AnswerCaches caches;
+	for(auto const& entry : options_.entries)
+	{
+		auto const directives =
+			parse_script_directives(load_script(nullptr, entry.script));
+		if(directives.memoize.any())
+			caches.emplace_back(std::make_unique<AnswerCache>(
+				directives.memoize, options_.memo_capacity));
+		else
+			caches.emplace_back();
+	}
+	// Every round plays each pairing once before moving on to the next one,
+	// so an interrupted tournament still has balanced results.
+	std::vector<Match> matches;
+	matches.reserve(n * (n - 1U) / 2U * options_.games);
+	for(uint32_t g = 0U; g < options_.games; g++)
+	{
+		for(size_t a = 0U; a < n; a++)
+		{
+			for(size_t b = a + 1U; b < n; b++)
+			{
+				if(g % 2U == 0U)
+					matches.push_back(Match{a, b});
+				else
+					matches.push_back(Match{b, a});
+			}
+		}
+	}
+	auto const threads = static_cast<unsigned>(
+		std::clamp<size_t>(options_.threads, 1U, matches.size()));
+	std::atomic<size_t> next_match{0U};
+	std::vector<Stats> stats(threads, Stats(n));
+	auto const start = Clock::now();
+	{
+		std::vector<std::thread> workers;
+		for(unsigned i = 0U; i < threads; i++)
+		{
+			workers.emplace_back(
+				[&, &shard_stats = stats[i]]()
+				{
+					for(;;)
+					{
+						auto const index =
+							next_match.fetch_add(1U, std::memory_order_relaxed);
+						if(index >= matches.size())
+							break;
+						play(options_, caches, endpoints, matches[index],
+						     shard_stats);
+					}
+				});
+		}
+		for(auto& worker : workers)
+			worker.join();
+	}
+	auto const elapsed = std::chrono::duration<double>(Clock::now() - start);
+	Stats total(n);
+	for(auto const& s : stats)
+		total.merge(s);
+	print_report(options_, total, elapsed.count(), threads);
+}
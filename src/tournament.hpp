@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024, Dylam De La Torre <dyxel04@gmail.com>
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+#ifndef EDOPRO_DESKBOT_TOURNAMENT_HPP
+#define EDOPRO_DESKBOT_TOURNAMENT_HPP
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Plays every pairing of (deck, script) entries against each other a given
+// amount of times, with a host and a joining Client per game against a server.
+// Games are pulled from a shared queue by one worker per thread, so long games
+// don't leave threads idle, then win-rate, game-length and decision-latency
+// tables are reported.
+class Tournament
+{
+public:
+	struct Entry
+	{
+		std::string name; // Shown in the report.
+		std::vector<uint32_t> deck;
+		std::string script;
+	};
+
+	struct Options
+	{
+		std::string_view host;
+		std::string_view port;
+		std::vector<Entry> entries;
+		uint32_t games;   // Per pairing, alternating who hosts.
+		uint32_t timeout; // Seconds a game may last, or 0 for no limit.
+		unsigned threads;
+		size_t memo_capacity; // Of each entry's answer cache.
+	};
+
+	explicit Tournament(Options options);
+
+	// Runs until every game finished, then prints the report to stdout.
+	// Throws if there's nothing to play, a script has malformed directives or
+	// the server can't be resolved.
+	auto run() -> void;
+
+private:
+	Options options_;
+};
+
+#endif // EDOPRO_DESKBOT_TOURNAMENT_HPP